@@ -2,6 +2,7 @@
 #define BUTTONS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define NUM_BUTTONS 6
 
@@ -14,8 +15,22 @@ enum Button {
     BTN_A = 11
 };
 
+// Bits of the button masks.
+#define BTN_LEFT_BIT (1 << 0)
+#define BTN_RIGHT_BIT (1 << 1)
+#define BTN_UP_BIT (1 << 2)
+#define BTN_DOWN_BIT (1 << 3)
+#define BTN_A_BIT (1 << 4)
+#define BTN_B_BIT (1 << 5)
+
 void buttons_init(void);
 bool btn_pressed(enum Button btn);
 bool btn_released(enum Button btn);
 
+// Buttons held down.
+uint8_t btn_pressed_mask(void);
+
+// Buttons released since the last call (like btn_released for all of them).
+uint8_t btn_released_mask(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+#ifndef CARTRIDGE_H
+#define CARTRIDGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "buttons.h"
+#include "chip8.h"
+
+/* Layout of a game cartridge (see tools/cartridge8): every ROM has a slot of 8
+blocks, a metadata block followed by the ROM itself.
+
+Metadata block:
+    0       0xC8 if the slot holds a ROM
+    1-11    Title, 0 terminated
+    12-15   CPU frequency (big-endian)
+    16      Timer frequency
+    17      Refresh frequency
+    18      Quirks (see QUIRK_SHIFT_VX...)
+    19-30   Key masks of the left, right, up, down, A and B buttons (big-endian)
+    31-46   User flags (see USER_FLAGS_IDX)
+    47      Block of the slot the input recording starts at (see replay.h), or 0.
+            The ROM ends before it.
+    48      1 to run the ROM on the frame-sliced scheduler (see chip8_frame)
+    49-50   CARTRIDGE_EXT_MAGIC, CARTRIDGE_EXT_VERSION if bytes 47 on are set.
+            Older versions of cartridge8 only wrote bytes 0-34 and left the
+            rest of the block as it was, so without these 47 on count as 0.
+
+The save states of the ROMs (see savestate.h) follow the last slot, in the
+same order. */
+#define CARTRIDGE_MAX_ROMS 25
+#define CARTRIDGE_SLOT_BLOCKS 8
+#define CARTRIDGE_ROM_BLOCKS (CARTRIDGE_SLOT_BLOCKS - 1)
+#define CARTRIDGE_SAVES_START (CARTRIDGE_MAX_ROMS * CARTRIDGE_SLOT_BLOCKS)
+#define CARTRIDGE_MAGIC 0xC8
+#define CARTRIDGE_EXT_MAGIC 'X'
+#define CARTRIDGE_EXT_VERSION 1
+#define CARTRIDGE_TITLE_LEN 10
+
+// A ROM's settings, parsed from its metadata block.
+typedef struct CARTRIDGE_META {
+    char title[CARTRIDGE_TITLE_LEN + 1];
+    uint32_t cpu_freq;
+    uint32_t timer_freq;
+    uint32_t refresh_freq;
+    bool quirks[NUM_QUIRKS];
+
+    // Keys mapped to each button, in the order of the button mask bits.
+    uint16_t btn_maps[NUM_BUTTONS];
+
+    uint8_t replay_block;
+
+    // Run a whole frame of instructions at a time (chip8_frame), not chip8_cycle.
+    bool frame_sliced;
+} CARTRIDGE_META;
+
+// Parses a metadata block. Returns false if the slot holds no ROM.
+bool cartridge_parse(const uint8_t *block, CARTRIDGE_META *meta);
+
+// Settings used for a ROM that has no metadata.
+void cartridge_default(CARTRIDGE_META *meta);
+
+/* Marks where in the slot the input recording starts (0 for none), marking
+bytes 47 on as set. */
+void cartridge_set_replay_block(uint8_t *block, CARTRIDGE_META *meta, uint8_t replay_block);
+
+// Blocks of the slot a ROM needs, not counting the zeros it ends with.
+uint8_t cartridge_rom_blocks(const uint8_t *rom, int size);
+
+// Converts a mask of buttons to the mask of keys they are mapped to.
+uint16_t cartridge_btns_to_keys(const CARTRIDGE_META *meta, uint8_t btns);
+
+#endif
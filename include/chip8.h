@@ -4,11 +4,19 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "chip8_ops.h"
+
 #define ONE_SEC 1000
 
 #define DISPLAY_WIDTH 128
 #define DISPLAY_WIDTH_BYTES (DISPLAY_WIDTH / 8)
 #define DISPLAY_HEIGHT 64
+#define DISPLAY_PAGES (DISPLAY_HEIGHT / 8)
+
+#define LORES_WIDTH (DISPLAY_WIDTH / 2)
+#define LORES_WIDTH_BYTES (LORES_WIDTH / 8)
+#define LORES_HEIGHT (DISPLAY_HEIGHT / 2)
+#define LORES_PAGES (LORES_HEIGHT / 8)
 
 #define NUM_KEYS 16
 #define NUM_REGISTERS 16
@@ -28,34 +36,175 @@
 #define CPU_FREQ_DEFAULT 500
 #define REFRESH_FREQ_DEFAULT 30
 #define TIMER_FREQ_DEFAULT 60
+#define RAND_SEED_DEFAULT 69
+
+// Instructions executed per cycle when the CPU isn't throttled.
+#define CPU_BATCH_UNTHROTTLED 256
+
+// Most time (in ms) the CPU will catch up on if a cycle comes in late.
+#define CPU_CATCHUP_DEFAULT 50
 
 #define USER_FLAGS_IDX 31
 
-// The states each key of the keypad can be in.
+/* Keep a predecoded copy of every instruction in RAM (8 KB of SRAM).
+Set to 0 to decode every instruction as it is executed instead. */
+#ifndef CHIP8_DECODE_CACHE
+#define CHIP8_DECODE_CACHE 1
+#endif
+
+/* Count every instruction executed and what it cost (see cycles.h), per
+handler. Adds about 2 KB to CHIP8. */
+#ifndef CHIP8_PROFILE
+#define CHIP8_PROFILE 0
+#endif
+
+// Cost buckets of the profile: <16, <64, <256 ... (powers of 4), then the rest.
+#define CHIP8_PROFILE_BUCKETS 8
+
+/* Bind handlers with the quirks built in when a ROM uses one of the quirk sets
+below. Set to 0 to always use the generic handlers, which test every quirk. */
+#ifndef CHIP8_SPECIALIZE
+#define CHIP8_SPECIALIZE 1
+#endif
+
+// The quirks, in the order of metadata byte 18.
+#define QUIRK_SHIFT_VX (1 << 0)      // 8xy6/8xyE shift Vx instead of Vy.
+#define QUIRK_KEEP_I (1 << 1)        // Fx55/Fx65 leave I alone.
+#define QUIRK_JP_VX (1 << 2)         // Bnnn jumps to nnn + Vx.
+#define QUIRK_LORES_8X16 (1 << 3)    // Dxy0 draws an 8x16 sprite in lores.
+#define QUIRK_KEEP_DISPLAY (1 << 4)  // 00FE/00FF don't clear the display.
+#define QUIRK_CLIP (1 << 5)          // Sprites are clipped instead of wrapped.
+#define QUIRK_COUNT_ROWS (1 << 6)    // Hires collisions count the rows that collided.
+#define QUIRK_BOTTOM (1 << 7)        // Hires sprites collide with the bottom of the screen.
+
+/* Quirk sets with specialized handlers, as Q(name, quirks): most modern
+interpreters (Octo), the original COSMAC VIP one and S-CHIP 1.1. */
+#define CHIP8_QUIRK_SETS(Q)     \
+    Q(modern, 0x00)             \
+    Q(vip, QUIRK_CLIP)          \
+    Q(schip, 0xFF)
+
+/* Store the display the way the ST7567 does: 8 pages of 128 column bytes, with
+the top pixel of each column in bit 0. Otherwise the display is stored as 64
+rows of 16 bytes, with the leftmost pixel of each byte in bit 7. */
+#ifndef CHIP8_PAGE_MAJOR
+#define CHIP8_PAGE_MAJOR 0
+#endif
+
+// The reasons chip8_run can stop before its budget runs out.
+typedef enum {
+    CHIP8_STOP_NONE,      // The whole budget was executed.
+    CHIP8_STOP_DISPLAY,   // The display was written (00E0, Dxyn, scroll or mode switch).
+    CHIP8_STOP_KEY_WAIT,  // Fx0A is waiting for a key.
+    CHIP8_STOP_TIMER,     // The delay or sound timer was written.
+    CHIP8_STOP_EXIT,      // The ROM called EXIT (00FD).
+    CHIP8_STOP_HALT,      // The ROM hit HALT (0000).
+    CHIP8_STOP_IDLE       // The ROM entered a loop that waits on a timer or key.
+} CHIP8_STOP;
+
+// What an idle CPU is waiting for before it executes anything again.
+typedef enum {
+    CHIP8_IDLE_NONE,   // Not idle.
+    CHIP8_IDLE_TIMER,  // Polling the delay timer (Fx07, 3x00, 1nnn).
+    CHIP8_IDLE_KEY     // Waiting on Fx0A, or stuck in HALT or a jump to itself.
+} CHIP8_IDLE;
+
+// Indices into the instruction handler table (see chip8_ops.h).
+#define CHIP8_OP_ENUM(name, handler, lo, hi, mnemonic) CHIP8_OP_##name,
 typedef enum {
-    KEY_UP,
-    KEY_DOWN,
-    KEY_RELEASED
-} CHIP8K;
+    CHIP8_OP_TRAP,
+    CHIP8_OP_DECODE,
+    CHIP8_OPS(CHIP8_OP_ENUM)
+    NUM_CHIP8_OPS
+} CHIP8_OP;
+#undef CHIP8_OP_ENUM
+
+/* Monochrome framebuffers in the layout selected by CHIP8_PAGE_MAJOR: the
+display, and the half size plane lo-res programs draw on. */
+#if CHIP8_PAGE_MAJOR
+typedef uint8_t CHIP8_FB[DISPLAY_PAGES][DISPLAY_WIDTH];
+typedef uint8_t CHIP8_LORES_FB[LORES_PAGES][LORES_WIDTH];
+#else
+typedef uint8_t CHIP8_FB[DISPLAY_HEIGHT][DISPLAY_WIDTH_BYTES];
+typedef uint8_t CHIP8_LORES_FB[LORES_HEIGHT][LORES_WIDTH_BYTES];
+#endif
+
+// A decoded instruction.
+typedef struct CHIP8I {
+    // Index of the handler that executes the instruction.
+    uint8_t op;
+
+    // The last 4 bits of the first byte.
+    uint8_t x;
+
+    // The first 4 bits of the second byte.
+    uint8_t y;
+
+    // The second byte.
+    uint8_t kk;
+} CHIP8I;
+
+// The last 12 bits of a decoded instruction.
+#define CHIP8I_NNN(in) ((uint16_t)(((in)->x << 8) | (in)->kk))
+
+// The last 4 bits of a decoded instruction.
+#define CHIP8I_N(in) ((in)->kk & 0x0F)
+
+// Executes a decoded instruction.
+struct CHIP8;
+typedef void (*CHIP8OP)(struct CHIP8 *chip8, const CHIP8I *in);
+
+/* Everything the emulator needs from outside, so instances share no state.
+Each hook is passed ctx. */
+typedef struct CHIP8_HOOKS {
+    // Returns the time in ms. Required.
+    uint32_t (*clock)(void *ctx);
+
+    // Returns a random byte for Cxkk. Defaults to the instance's xorshift.
+    uint8_t (*rand)(void *ctx);
+
+    /* Stores the metadata block of ROM rom_num after the user flags in it have
+    changed. Optional, without it the flags only last until power off. */
+    void (*save)(void *ctx, uint8_t rom_num, const uint8_t *metadata);
+
+    void *ctx;
+} CHIP8_HOOKS;
 
 typedef struct CHIP8 {
     // Represents random-access memory.
     uint8_t RAM[MAX_RAM];
 
+#if CHIP8_DECODE_CACHE
+    /* The decoded instruction at each even address of RAM. Entries are
+    decoded on first execution and invalidated whenever RAM is written. */
+    CHIP8I decoded[MAX_RAM / 2];
+#endif
+
     // Represents general-purpose 8-bit registers.
     uint8_t V[NUM_REGISTERS];
 
     // Program counter, stack pointer, and index 16-bit registers.
     uint16_t PC, SP, I;
 
-    // Delay timer and sound timer 8-bit registers.
-    uint8_t DT, ST;
+    /* Delay timer and sound timer 8-bit registers. With timer_ticks they are
+    counted down by chip8_tick_timers, which may run from an interrupt. */
+    volatile uint8_t DT, ST;
+
+    /* A monochrome display. A pixel can be either only on or off, no color.
+    In lores it only holds the lo-res plane scaled up as of chip8_present. */
+    CHIP8_FB display;
+
+    // What lores programs draw on: 64x32 pixels, without any scaling.
+    CHIP8_LORES_FB lores;
 
-    // A monochrome display. A pixel can be either only on or off, no color.
-    uint8_t display[DISPLAY_HEIGHT][DISPLAY_WIDTH_BYTES];
+    /* Parts of the display changed since it was last drawn. One word per
+    8-row page, with bit b set if display bytes (columns) b*8..b*8+7 changed. */
+    uint16_t display_dirty[DISPLAY_PAGES];
 
-    // Represents if a key is down, up, or released.
-    CHIP8K keypad[NUM_KEYS];
+    /* The keypad, with bit k for key k. Keys that are held down, and keys
+    released since the last frame (cleared at the end of chip8_cycle). */
+    uint16_t keys_down;
+    uint16_t keys_released;
 
     // Where the emulator begins reading instructions.
     uint16_t pc_start_addr;
@@ -64,51 +213,84 @@ typedef struct CHIP8 {
     uint32_t cpu_freq;
     uint32_t timer_freq;
     uint32_t refresh_freq;
-    uint32_t timer_max_cum;
-    uint32_t cpu_max_cum;
-    uint32_t cpu_cum;
+    uint32_t cpu_catchup;
+    uint32_t cpu_debt;
+
+    /* Progress towards the next timer tick, in ms * timer_freq (a tick is
+    ONE_SEC of it). Unused with timer_ticks. */
     uint32_t sound_cum;
     uint32_t delay_cum;
+
+    // The timers are ticked from outside (chip8_tick_timers), not by chip8_cycle.
+    bool timer_ticks;
+
     uint32_t refresh_max_cum;
     uint32_t refresh_cum;
     uint32_t prev_cycle_start;
     uint32_t cur_cycle_start;
     uint32_t total_cycle_time;
 
-    // Flags for the various quirky behavior of S-CHIP
-    /* Quirks:
-        -0: 8xy6/8xyE
-        -1: Fx55/Fx65
-        -2: Bnnn
-        -3: Big Sprite LORES
-        -4: 00FE/00FF
-        -5: Sprite Wrapping
-        -6: Collision Enumeration
-        -7: Collision with Bottom of Screen
-    */
-    bool quirks[NUM_QUIRKS];
+    // Flags for the various quirky behavior of S-CHIP (QUIRK_*).
+    uint8_t quirks;
+
+    // The handler of each CHIP8_OP, specialized for the quirks if possible.
+    const CHIP8OP *ops;
 
     // Used to signal to main to update the display.
     bool display_updated;
 
     // Used to signal to main to produce sound.
-    bool beep;
+    volatile bool beep;
 
     // Used to signal to main to exit the program.
     bool exit;
 
+    // Why the last call to chip8_run stopped.
+    CHIP8_STOP stop;
+
+    // Number of instructions executed since reset.
+    uint32_t num_instrs;
+
+    /* What the CPU is waiting for, if it's idle. Idle time is accounted as
+    instructions skipped rather than executed. */
+    volatile CHIP8_IDLE idle;
+    uint32_t num_idle_instrs;
+
     // Used to toggle between HI-RES and standard LO-RES modes.
     bool hires;
 
+#if CHIP8_PROFILE
+    // Times each handler ran, their total cost and a histogram of the cost.
+    uint32_t op_count[NUM_CHIP8_OPS];
+    uint64_t op_cost[NUM_CHIP8_OPS];
+    uint32_t op_hist[NUM_CHIP8_OPS][CHIP8_PROFILE_BUCKETS];
+#endif
+
+    // Number of unknown instructions executed, and the last one of them.
+    uint32_t num_traps;
+    uint16_t last_trap;
+
     // Mainly for reading/writing userflags
     uint8_t *metadata;
     uint8_t rom_num;
+
+    CHIP8_HOOKS hooks;
+
+    // State of the default random source (never 0).
+    uint32_t rand_state;
 } CHIP8;
 
 // Set some things to useful default values.
 void chip8_init(CHIP8 *chip8, unsigned long cpu_freq, unsigned long timer_freq,
                 unsigned long refresh_freq, uint16_t pc_start_addr,
-                bool quirks[], uint8_t *metadata, uint8_t rom_num);
+                const bool quirks[], uint8_t *metadata, uint8_t rom_num,
+                const CHIP8_HOOKS *hooks);
+
+// Changes the quirks (QUIRK_* bits), binding the handlers that match them.
+void chip8_set_quirks(CHIP8 *chip8, uint8_t quirks);
+
+// Restarts the default random source from seed.
+void chip8_seed(CHIP8 *chip8, uint32_t seed);
 
 // Reset the machine.
 void chip8_reset(CHIP8 *chip8);
@@ -119,9 +301,22 @@ void chip8_reset(CHIP8 *chip8);
 // Sets the CPU frequency of the machine.
 void chip8_set_cpu_freq(CHIP8 *chip8, unsigned long cpu_freq);
 
+// Sets the most time (in ms) the CPU may catch up on in a single cycle.
+void chip8_set_cpu_catchup(CHIP8 *chip8, unsigned long cpu_catchup);
+
 // Sets the timer frequency of the machine.
 void chip8_set_timer_freq(CHIP8 *chip8, unsigned long timer_freq);
 
+/* Lets something outside tick the timers at timer_freq (such as a timer
+interrupt) instead of chip8_cycle. */
+void chip8_set_timer_ticks(CHIP8 *chip8, bool timer_ticks);
+
+/* Counts the delay and sound timers down by one tick and updates beep. The
+interpreter only ever stores to DT and ST, so this is safe to call from an
+interrupt while it runs. Fx18 sets beep itself, so the buzzer follows ST from
+the instruction that sets it to the tick that ends it. */
+void chip8_tick_timers(CHIP8 *chip8);
+
 // Sets the refresh frequency of the machine.
 void chip8_set_refresh_freq(CHIP8 *chip8, unsigned long refresh_freq);
 
@@ -136,24 +331,72 @@ handling timers. Returns true if instruction was executed
 or false if the CPU was sleeping. */
 bool chip8_cycle(CHIP8 *chip8);
 
+/* Runs one frame of the frame-sliced scheduler, in place of chip8_cycle:
+exactly cpu_freq / timer_freq instructions (carrying the fraction over to the
+next frame), then one tick of the timers, then a display refresh. Doesn't look
+at the clock, so the caller has to call it timer_freq times a second. Returns
+true if an instruction was executed. */
+bool chip8_frame(CHIP8 *chip8);
+
 // Fetches, decodes, and executes the next instruction.
 void chip8_execute(CHIP8 *chip8);
 
+/* Executes up to budget instructions, stopping early after any instruction
+that needs attention from outside the interpreter. Released keys are only
+reset once the batch is done. Returns the reason it stopped. */
+CHIP8_STOP chip8_run(CHIP8 *chip8, uint32_t budget);
+
+// Decodes the instruction made up of bytes b1 and b2.
+void chip8_decode(uint8_t b1, uint8_t b2, CHIP8I *in);
+
+// Must be called after writing len bytes of RAM starting at addr.
+void chip8_invalidate(CHIP8 *chip8, uint16_t addr, int len);
+
+#if CHIP8_PROFILE
+// Writes the instruction profile as a table, a line at a time, through write_str.
+void chip8_profile_dump(CHIP8 *chip8, void (*write_str)(const char *str));
+
+// Clears the instruction profile.
+void chip8_profile_reset(CHIP8 *chip8);
+#endif
+
 // Decrements delay and sound timers at specified frequency.
 void chip8_handle_timers(CHIP8 *chip8);
 
+/* Returns the ms after the last chip8_cycle that the next one has anything to
+do (instructions owed, a timer tick or a refresh), or 0 if it always has.
+Key presses and timer ticks from outside come on top of this. */
+uint32_t chip8_next_cycle_ms(CHIP8 *chip8);
+
 // Updates the total cycle time since last call.
 void chip8_update_elapsed_time(CHIP8 *chip8);
 
+// Presses a mask of keys, waking the CPU if it was waiting on the keypad.
+void chip8_press_keys(CHIP8 *chip8, uint16_t keys);
+
+// Releases a mask of keys, waking the CPU if it was waiting on the keypad.
+void chip8_release_keys(CHIP8 *chip8, uint16_t keys);
+
+/* Returns the percentage of instructions since reset that were skipped
+because the CPU was idle. */
+uint8_t chip8_idle_percent(CHIP8 *chip8);
+
 // Clears the keypad by setting all keys to up.
 void chip8_reset_keypad(CHIP8 *chip8);
 
-// Resets any key that was released to KEY_UP.
-void chip8_reset_released_keys(CHIP8 *chip8);
-
 // Clears the display by setting all pixels to off.
 void chip8_reset_display(CHIP8 *chip8);
 
+// Marks the whole display as changed.
+void chip8_mark_display_dirty(CHIP8 *chip8);
+
+/* Brings the changed parts of the display up to date with the lo-res plane,
+so call it before drawing the display. Does nothing in hires. */
+void chip8_present(CHIP8 *chip8);
+
+// Switches between lores and hires, carrying what's on screen over to the new mode.
+void chip8_set_hires(CHIP8 *chip8, bool hires);
+
 // Clears the RAM.
 void chip8_reset_RAM(CHIP8 *chip8);
 
@@ -179,9 +422,9 @@ bool chip8_handle_user_flags(CHIP8 *chip8, int num_flags, bool save);
 void chip8_skip_instr(CHIP8 *chip8);
 
 // Sets a pixel on or off
-void chip8_set_pixel(uint8_t buf[DISPLAY_HEIGHT][DISPLAY_WIDTH_BYTES], int x, int y, bool on);
+void chip8_set_pixel(CHIP8_FB buf, int x, int y, bool on);
 
 // Gets a pixel's on/off status
-bool chip8_get_pixel(uint8_t buf[DISPLAY_HEIGHT][DISPLAY_WIDTH_BYTES], int x, int y);
+bool chip8_get_pixel(CHIP8_FB buf, int x, int y);
 
 #endif
@@ -0,0 +1,94 @@
+#ifndef CHIP8_OPS_H
+#define CHIP8_OPS_H
+
+/* The instruction set as understood by the interpreter.
+ *
+ * Every instruction is listed once as OP(name, handler, lo, hi, mnemonic).
+ * Instructions that own a whole top nibble are listed in CHIP8_MAIN_OPS with
+ * lo/hi being that nibble. Top nibbles shared by several instructions form a
+ * family (see CHIP8_FAMILIES) with their own list, where lo..hi is the range
+ * of the family key (low byte or low nibble of the instruction).
+ *
+ * The decode tables, handler table and opcode enum in chip8.c are all
+ * generated from these lists. Anything not listed goes to the trap handler. */
+
+// F(nibble, family, key mask)
+#define CHIP8_FAMILIES(F) \
+    F(0x0, SYS, 0xFF)     \
+    F(0x5, SE, 0x0F)      \
+    F(0x8, ALU, 0x0F)     \
+    F(0xE, KEY, 0xFF)     \
+    F(0xF, MISC, 0xFF)
+
+#define CHIP8_MAIN_OPS(OP)                           \
+    OP(JP, jp, 0x1, 0x1, "JP addr")                  \
+    OP(CALL, call, 0x2, 0x2, "CALL addr")            \
+    OP(SE_BYTE, se_byte, 0x3, 0x3, "SE Vx, byte")    \
+    OP(SNE_BYTE, sne_byte, 0x4, 0x4, "SNE Vx, byte") \
+    OP(LD_BYTE, ld_byte, 0x6, 0x6, "LD Vx, byte")    \
+    OP(ADD_BYTE, add_byte, 0x7, 0x7, "ADD Vx, byte") \
+    OP(SNE_REG, sne_reg, 0x9, 0x9, "SNE Vx, Vy")     \
+    OP(LD_I, ld_i, 0xA, 0xA, "LD I, addr")           \
+    OP(JP_V0, jp_v0, 0xB, 0xB, "JP V0, addr")        \
+    OP(RND, rnd, 0xC, 0xC, "RND Vx, byte")           \
+    OP(DRW, drw, 0xD, 0xD, "DRW Vx, Vy, n")
+
+// 00kk
+#define CHIP8_SYS_OPS(OP)              \
+    OP(HALT, halt, 0x00, 0x00, "HALT") \
+    OP(SCD, scd, 0xC0, 0xCF, "SCD n")  \
+    OP(SCU, scu, 0xD0, 0xDF, "SCU n")  \
+    OP(CLS, cls, 0xE0, 0xE0, "CLS")    \
+    OP(RET, ret, 0xEE, 0xEE, "RET")    \
+    OP(SCR, scr, 0xFB, 0xFB, "SCR")    \
+    OP(SCL, scl, 0xFC, 0xFC, "SCL")    \
+    OP(EXIT, exit, 0xFD, 0xFD, "EXIT") \
+    OP(LOW, low, 0xFE, 0xFE, "LOW")    \
+    OP(HIGH, high, 0xFF, 0xFF, "HIGH")
+
+// 5xyn
+#define CHIP8_SE_OPS(OP) \
+    OP(SE_REG, se_reg, 0x0, 0x0, "SE Vx, Vy")
+
+// 8xyn
+#define CHIP8_ALU_OPS(OP)                        \
+    OP(LD_REG, ld_reg, 0x0, 0x0, "LD Vx, Vy")    \
+    OP(OR, or, 0x1, 0x1, "OR Vx, Vy")            \
+    OP(AND, and, 0x2, 0x2, "AND Vx, Vy")         \
+    OP(XOR, xor, 0x3, 0x3, "XOR Vx, Vy")         \
+    OP(ADD_REG, add_reg, 0x4, 0x4, "ADD Vx, Vy") \
+    OP(SUB, sub, 0x5, 0x5, "SUB Vx, Vy")         \
+    OP(SHR, shr, 0x6, 0x6, "SHR Vx {, Vy}")      \
+    OP(SUBN, subn, 0x7, 0x7, "SUBN Vx, Vy")      \
+    OP(SHL, shl, 0xE, 0xE, "SHL Vx {, Vy}")
+
+// Exkk
+#define CHIP8_KEY_OPS(OP)                 \
+    OP(SKP, skp, 0x9E, 0x9E, "SKP Vx")    \
+    OP(SKNP, sknp, 0xA1, 0xA1, "SKNP Vx")
+
+// Fxkk
+#define CHIP8_MISC_OPS(OP)                             \
+    OP(LD_VX_DT, ld_vx_dt, 0x07, 0x07, "LD Vx, DT")    \
+    OP(LD_VX_K, ld_vx_k, 0x0A, 0x0A, "LD Vx, K")       \
+    OP(LD_DT_VX, ld_dt_vx, 0x15, 0x15, "LD DT, Vx")    \
+    OP(LD_ST_VX, ld_st_vx, 0x18, 0x18, "LD ST, Vx")    \
+    OP(ADD_I, add_i, 0x1E, 0x1E, "ADD I, Vx")          \
+    OP(LD_F, ld_f, 0x29, 0x29, "LD F, Vx")             \
+    OP(LD_HF, ld_hf, 0x30, 0x30, "LD HF, Vx")          \
+    OP(LD_B, ld_b, 0x33, 0x33, "LD B, Vx")             \
+    OP(LD_MEM_VX, ld_mem_vx, 0x55, 0x55, "LD [I], Vx") \
+    OP(LD_VX_MEM, ld_vx_mem, 0x65, 0x65, "LD Vx, [I]") \
+    OP(LD_R_VX, ld_r_vx, 0x75, 0x75, "LD R, Vx")       \
+    OP(LD_VX_R, ld_vx_r, 0x85, 0x85, "LD Vx, R")
+
+// Every instruction, in handler table order (after the trap handler).
+#define CHIP8_OPS(OP)  \
+    CHIP8_MAIN_OPS(OP) \
+    CHIP8_SYS_OPS(OP)  \
+    CHIP8_SE_OPS(OP)   \
+    CHIP8_ALU_OPS(OP)  \
+    CHIP8_KEY_OPS(OP)  \
+    CHIP8_MISC_OPS(OP)
+
+#endif
@@ -3,7 +3,19 @@
 
 #include <stdint.h>
 
+/* Monotonic time since clock_start(). The microsecond count is 64 bits so it
+never wraps, and reading it is safe from any interrupt. */
+
 void clock_start(void);
+
+// Microseconds since clock_start().
+uint64_t clock_us(void);
+
+// Milliseconds since clock_start().
 uint32_t clock_get(void);
 
+/* Raises an interrupt when clock_us() reaches us, to wake the CPU from sleep
+(board only). Times more than a counter period away may fire early. */
+void clock_alarm(uint64_t us);
+
 #endif
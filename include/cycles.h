@@ -0,0 +1,13 @@
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include <stdint.h>
+
+// A free running counter for timing short stretches of code. It counts CPU
+// cycles on the board and nanoseconds on the host.
+
+void cycles_init(void);
+uint32_t cycles_get(void);
+uint32_t cycles_to_us(uint32_t cycles);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef DELAY_H
 #define DELAY_H
 
+/* Blocks for at least ms ms while the CPU sleeps. Needs swtimer_init(), and
+can't be called from an interrupt or timer callback. */
 void delay(int ms);
 
 #endif
@@ -7,7 +7,11 @@ void display_init(void);
 void display_send_data(uint8_t data);
 void display_send_cmd(uint8_t cmd);
 void display_clear(void);
-void display_draw(uint8_t buf[64][16]);
+// Draws the parts of buf marked in dirty (a bit per 8 columns of each page),
+// then clears dirty.
+void display_draw(const uint8_t buf[64][16], uint16_t dirty[8]);
+// Same as display_draw, but buf is already in page order (bit 0 topmost).
+void display_draw_pages(const uint8_t buf[8][128], uint16_t dirty[8]);
 void display_print(uint8_t x, uint8_t y, const char *str);
 
 void display_test(void);
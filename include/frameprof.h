@@ -0,0 +1,65 @@
+#ifndef FRAMEPROF_H
+#define FRAMEPROF_H
+
+#include <stdint.h>
+
+/* Breaks the time of each displayed frame down into the phases of the main loop
+and streams it out of UART as binary records (see tools/frame_viewer.py).
+
+Phases are timed with the cycle counter (DWT CYCCNT on the board), except
+FRAME_IDLE which is timed on clock_us(): CYCCNT stops while the core is
+gated in WFI (unless DBGMCU_CR.DBG_SLEEP is set), so it would read near 0.
+
+The records take over UART1: frameprof_init re-times it to FRAMEPROF_BAUD, and
+the main loop stops answering requests on it (see handle_uart).
+
+Every record is: 0xA5, type, payload length, payload, 8-bit sum of payload.
+All values are little-endian uint16 and times are in us.
+    FRAME_RECORD:  frame number, main loop iterations, time of each phase
+    WINDOW_RECORD: frames in window, then min, avg, max of each phase */
+#ifndef FRAME_PROFILE
+#define FRAME_PROFILE 0
+#endif
+
+// Baud rate the records are sent at.
+#define FRAMEPROF_BAUD 500000
+
+// Frames the min/avg/max are taken over.
+#define FRAMEPROF_WINDOW 60
+
+#define FRAMEPROF_SYNC 0xA5
+#define FRAMEPROF_FRAME_RECORD 0x01
+#define FRAMEPROF_WINDOW_RECORD 0x02
+
+typedef enum FRAME_PHASE {
+    FRAME_INPUT,     // Polling buttons (starts every main loop iteration)
+    FRAME_CPU,       // chip8_cycle
+    FRAME_SOUND,     // Starting/stopping the buzzer
+    FRAME_DISPLAY,   // Sending the display over SPI
+    FRAME_SD,        // Blocking SD writes (user flags)
+    FRAME_IDLE,      // Sleeping until there is something to do
+    FRAME_PROFILER,  // The profiler itself (mostly UART)
+    NUM_FRAME_PHASES
+} FRAME_PHASE;
+
+#if FRAME_PROFILE
+void frameprof_init(void);
+
+// Ends the current phase and starts another. Returns the phase that ended.
+FRAME_PHASE frameprof_phase(FRAME_PHASE phase);
+
+// Ends a displayed frame and sends its records.
+void frameprof_end_frame(void);
+#else
+static inline void frameprof_init(void) {
+}
+
+static inline FRAME_PHASE frameprof_phase(FRAME_PHASE phase) {
+    return phase;
+}
+
+static inline void frameprof_end_frame(void) {
+}
+#endif
+
+#endif
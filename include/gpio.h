@@ -1,6 +1,7 @@
 #ifndef GPIO_H
 #define GPIO_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define RCC 0x40021000
@@ -31,6 +32,16 @@ typedef enum GPIO {
     GPIOG
 } GPIO;
 
+typedef enum GPIO_MODE {
+    GPIO_OUT,       // Push-pull output (2 MHz)
+    GPIO_ALT_OUT,   // Alternate function push-pull output (2 MHz)
+    GPIO_IN,        // Floating input
+    GPIO_IN_PULLUP  // Input with pull-up
+} GPIO_MODE;
+
 void gpio_init(GPIO port);
+void gpio_set_mode(GPIO port, int pin, GPIO_MODE mode);
+void gpio_write(GPIO port, int pin, bool on);
+bool gpio_read(GPIO port, int pin);
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+
+/* Sleeps the CPU while there is nothing to do, and keeps count of how long it
+slept. On the board it sleeps on WFI until an interrupt, on the host it blocks
+on a condition variable. Times are in us of clock_us(). */
+
+#define IDLE_FOREVER UINT64_MAX
+
+/* Sleeps until idle_wake() is called or clock_us() reaches deadline. A wake
+that came in since the last call returns right away. */
+void idle_until(uint64_t deadline);
+
+// Ends idle_until early. Called by interrupts that bring something to handle.
+void idle_wake(void);
+
+// Time spent in idle_until since clock_start().
+uint64_t idle_us(void);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdio.h>
+
+/* Helpers for the JSON the host tools (bench, farm) print. Not built into the
+firmware. */
+
+/* Prints str as a quoted JSON string, escaping quotes, backslashes and control
+characters. */
+void json_print_string(FILE *f, const char *str);
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "sd.h"
+
+/* Records the keypad and plays it back into an emulator.
+
+Events are stamped with the instruction count (executed plus idle, see
+chip8_cycle) they were applied at. Runs are only reproducible if the
+emulator's clock moves exactly 1 ms per chip8_cycle while recording and
+replaying, with replay_input called once before every cycle. Key changes are
+held back to the first cycle the count reaches a new value, so every stamp
+marks a single cycle.
+
+A recording is a run of 512-byte blocks, read and written through a
+REPLAY_STORE (spare blocks of a cartridge slot, or a host file). Everything is
+little-endian:
+    Header (first 8 bytes): 'R', 'P', version, 0, PRNG seed (uint32)
+    Events (8 bytes each):  instruction count (uint32), keys pressed (uint16),
+                            keys released (uint16)
+An all-zero event ends the recording. */
+#define REPLAY_VERSION 1
+#define REPLAY_EVENT_SIZE 8
+#define REPLAY_EVENTS_PER_BLOCK (SD_BLOCK_SIZE / REPLAY_EVENT_SIZE)
+
+// Cycles (ms) between writes of a partly filled block while recording.
+#define REPLAY_FLUSH_CYCLES 1000
+
+typedef struct REPLAY_STORE {
+    bool (*read)(void *ctx, uint32_t block, uint8_t *data);
+    bool (*write)(void *ctx, uint32_t block, const uint8_t *data);
+    void *ctx;
+
+    // Blocks available to the recording.
+    uint32_t num_blocks;
+} REPLAY_STORE;
+
+typedef enum REPLAY_MODE {
+    REPLAY_OFF,     // Keys go straight to the emulator
+    REPLAY_RECORD,  // Keys go to the emulator and into the recording
+    REPLAY_PLAY     // Keys come from the recording
+} REPLAY_MODE;
+
+typedef struct REPLAY_EVENT {
+    uint32_t instrs;
+    uint16_t pressed;
+    uint16_t released;
+} REPLAY_EVENT;
+
+typedef struct REPLAY {
+    REPLAY_MODE mode;
+    REPLAY_STORE store;
+
+    // The block being filled or played, and the slot of the next event in the recording.
+    uint8_t block[SD_BLOCK_SIZE];
+    uint32_t slot;
+
+    // Instruction count at the last cycle.
+    uint32_t count;
+
+    // Keys waiting for the count to move on before they are recorded.
+    uint16_t pressed;
+    uint16_t released;
+
+    uint32_t cycles;
+    bool dirty;
+
+    // Next event to play.
+    REPLAY_EVENT next;
+} REPLAY;
+
+/* Starts recording a freshly initialized emulator. Returns false if the store
+can't hold a recording. */
+bool replay_record(REPLAY *replay, const REPLAY_STORE *store, CHIP8 *chip8);
+
+/* Starts playing the recording in store back into a freshly initialized
+emulator, seeding it as it was recorded. Returns false if there is none. */
+bool replay_play(REPLAY *replay, const REPLAY_STORE *store, CHIP8 *chip8);
+
+/* Passes the keys pressed and released since the last cycle on to the
+emulator. Call once before every chip8_cycle. */
+void replay_input(REPLAY *replay, CHIP8 *chip8, uint16_t pressed, uint16_t released);
+
+// Ends recording or playback, writing out whatever is left.
+void replay_stop(REPLAY *replay);
+
+// Whether a store holds a recording.
+bool replay_exists(const REPLAY_STORE *store);
+
+#endif
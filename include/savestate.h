@@ -0,0 +1,41 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+/* Saves the whole emulator to the cartridge and loads it back.
+
+A save is an 8-byte header followed by the state packed with PackBits. A
+control byte below 128 is followed by that many plus one bytes to copy, and
+one of 128 or more by a byte to repeat (control - 125) times. Integers are
+little-endian.
+    Header: 'C', '8', 'S', version, framebuffer layout (CHIP8_PAGE_MAJOR), 0, 0, 0
+    State:  V0-VF, PC, SP, I (uint16), DT, ST, delay and sound timer progress,
+            PRNG state (uint32), hires, quirks, RAM (with the stack), display,
+            lo-res plane
+
+RAM is mostly zeros and the display mostly blank, so a save usually packs
+into a block or two. */
+#define SAVESTATE_VERSION 1
+
+// Blocks set aside for each save, enough for a state that doesn't pack at all.
+#define SAVESTATE_BLOCKS 12
+
+typedef enum SAVESTATE_RESULT {
+    SAVESTATE_LOADED,
+    SAVESTATE_NONE,   // No save for this build, or it couldn't be read: nothing changed
+    SAVESTATE_BROKEN  // The card failed partway through loading: the emulator is half loaded
+} SAVESTATE_RESULT;
+
+// Writes the emulator's state to the blocks from addr on, in one transfer.
+bool savestate_save(CHIP8 *chip8, uint32_t addr);
+
+/* Restores the state saved at addr. The save is read through and checked
+before anything is loaded, so the emulator is only left half loaded (and has
+to be restarted) if the card fails between the check and the load. */
+SAVESTATE_RESULT savestate_load(CHIP8 *chip8, uint32_t addr);
+
+#endif
@@ -12,4 +12,17 @@ bool sd_read_block(uint32_t addr, uint8_t *buffer);
 bool sd_read_blocks(uint32_t addr, uint8_t *buffer, int num_blocks);
 bool sd_write_block(uint32_t addr, const uint8_t *buffer);
 
+/* Streams blocks from addr on (CMD18): begin, one sd_read_next per block, then
+end. For reads that don't fit in memory at once. */
+bool sd_read_begin(uint32_t addr);
+bool sd_read_next(uint8_t *buffer);
+void sd_read_end(void);
+
+/* Writes blocks from addr on in one transfer (CMD25): begin, one sd_write_next
+per block, then end. sd_write_next returns while the card is still programming
+the block, so the next one can be prepared in the meantime. */
+bool sd_write_begin(uint32_t addr);
+bool sd_write_next(const uint8_t *buffer);
+bool sd_write_end(void);
+
 #endif
@@ -0,0 +1,38 @@
+#ifndef SPI_H
+#define SPI_H
+
+#include <stdint.h>
+
+// Transmit only, on a single data line.
+#define SPI_TX_ONLY (1 << 0)
+
+// CS is driven by software through GPIO instead of by the SPI.
+#define SPI_SOFT_CS (1 << 1)
+
+typedef enum SPI {
+    SPI1,
+    SPI2
+} SPI;
+
+// What the bus clock is divided by to get the SPI clock.
+typedef enum SPI_DIV {
+    SPI_DIV_2,
+    SPI_DIV_4,
+    SPI_DIV_8,
+    SPI_DIV_16,
+    SPI_DIV_32,
+    SPI_DIV_64,
+    SPI_DIV_128,
+    SPI_DIV_256
+} SPI_DIV;
+
+// (Re)configures the SPI as master. The pins must be set up by the caller.
+void spi_init(SPI spi, SPI_DIV div, int flags);
+
+// Sends a byte, waiting until it can be sent.
+void spi_write(SPI spi, uint8_t data);
+
+// Returns the byte received during the last write.
+uint8_t spi_read(SPI spi);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SWTIMER_H
+#define SWTIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Software timers multiplexed on a 1 ms tick (SysTick on the board, a thread
+on the host). Timers are kept in a wheel of SWTIMER_SLOTS lists by the tick
+they expire on, so a tick only looks at the timers in one slot.
+
+Callbacks run in the tick interrupt: they must be short and must not block
+(delay() in a callback never returns). They may start and stop timers. */
+
+// Slots in the wheel (a power of 2).
+#define SWTIMER_SLOTS 16
+
+#define SWTIMER_TICKS_PER_SEC 1000
+
+typedef void (*SWTIMER_FN)(void *arg);
+
+// A timer, owned by the caller and left alone by the wheel once stopped.
+typedef struct SWTIMER {
+    SWTIMER_FN fn;
+    void *arg;
+
+    // Tick it next fires on, and ticks between firings (0 for one-shot).
+    uint32_t expires;
+    uint32_t period;
+
+    struct SWTIMER *next;
+    volatile bool active;
+} SWTIMER;
+
+// Starts the tick. Nothing fires before this is called.
+void swtimer_init(void);
+
+/* Calls fn(arg) in ms ms (at least 1), then every period ms until stopped if
+period isn't 0. Restarts the timer if it is already running. */
+void swtimer_start(SWTIMER *timer, uint32_t ms, uint32_t period, SWTIMER_FN fn, void *arg);
+
+// Stops the timer. It won't fire after this returns.
+void swtimer_stop(SWTIMER *timer);
+
+// Whether the timer is still to fire.
+bool swtimer_active(const SWTIMER *timer);
+
+// Ticks since swtimer_init().
+uint32_t swtimer_ticks(void);
+
+// Advances the wheel a tick. Called by the tick source only.
+void swtimer_tick(void);
+
+/* Keep the tick from running while the wheel is changed. Provided by the tick
+source, and may be nested inside a callback. */
+void swtimer_lock(void);
+void swtimer_unlock(void);
+
+#endif
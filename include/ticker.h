@@ -0,0 +1,13 @@
+#ifndef TICKER_H
+#define TICKER_H
+
+// Slowest tick the 16-bit timer can count out.
+#define TICKER_MIN_FREQ 16
+
+/* Calls tick freq (TICKER_MIN_FREQ or more) times a second from a timer interrupt, until
+stopped. The period is exact on average even when freq doesn't divide the
+timer clock. */
+void ticker_start(unsigned long freq, void (*tick)(void));
+void ticker_stop(void);
+
+#endif
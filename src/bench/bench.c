@@ -0,0 +1,107 @@
+#include "bench.h"
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "json.h"
+
+/* Benchmarks the emulator on the host and prints the results as JSON.
+
+Usage: program [-n iters] [-t run_ms] [-f cpu_freq] [-q quirks] [-p] [rom ...]
+
+Micro-benchmarks time single operations (instructions, draws, scrolls, LCD
+updates). Macro runs play the built-in programs plus any ROMs given for run_ms
+of virtual time with scripted input. Built with CHIP8_PROFILE, -p also writes
+the instruction profile of each macro run to stderr. */
+
+static bool first_result = true;
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+void bench_begin(const char *section) {
+    printf(",\n  \"%s\": [", section);
+    first_result = true;
+}
+
+void bench_end(void) {
+    printf("\n  ]");
+}
+
+static void _next_result(void) {
+    printf(first_result ? "\n    " : ",\n    ");
+    first_result = false;
+}
+
+// Rates are 0 rather than inf or nan (which aren't JSON) if nothing was timed.
+static double _per(double count, double per) {
+    return per > 0 ? count / per : 0;
+}
+
+void bench_result(const char *name, uint64_t ops, uint64_t ns) {
+    _next_result();
+    printf("{\"name\": ");
+    json_print_string(stdout, name);
+    printf(", \"ops\": %llu, \"ns_per_op\": %.2f}", (unsigned long long)ops, _per(ns, ops));
+}
+
+void bench_run_result(const char *name, uint64_t instrs, uint64_t idle_instrs,
+                      uint64_t frames, uint64_t ns) {
+    double secs = ns / 1e9;
+
+    _next_result();
+    printf("{\"name\": ");
+    json_print_string(stdout, name);
+    printf(", \"instructions\": %llu, \"idle_instructions\": %llu, "
+           "\"frames\": %llu, \"instructions_per_sec\": %.0f, \"frames_per_sec\": %.1f}",
+           (unsigned long long)instrs, (unsigned long long)idle_instrs,
+           (unsigned long long)frames, _per(instrs, secs), _per(frames, secs));
+}
+
+int main(int argc, char **argv) {
+    long iters = BENCH_ITERS_DEFAULT;
+    long run_ms = BENCH_RUN_MS_DEFAULT;
+    uint32_t cpu_freq = BENCH_CPU_FREQ_DEFAULT;
+    uint8_t quirks = 0;
+    bool profile = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:f:q:p")) != -1) {
+        switch (opt) {
+        case 'n':
+            iters = strtol(optarg, NULL, 0);
+            break;
+        case 't':
+            run_ms = strtol(optarg, NULL, 0);
+            break;
+        case 'f':
+            cpu_freq = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            quirks = strtoul(optarg, NULL, 16);
+            break;
+        case 'p':
+            profile = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iters] [-t run_ms] [-f cpu_freq] [-q quirks] [-p] [rom ...]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("{\n  \"layout\": \"%s\",\n  \"decode_cache\": %d,\n  \"specialize\": %d",
+           CHIP8_PAGE_MAJOR ? "page-major" : "row-major", CHIP8_DECODE_CACHE, CHIP8_SPECIALIZE);
+
+    bench_micro(iters);
+    bench_macro(run_ms, cpu_freq, quirks, profile, &argv[optind], argc - optind);
+
+    printf("\n}\n");
+    return 0;
+}
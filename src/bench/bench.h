@@ -0,0 +1,42 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+// How many times each micro-benchmark repeats its operation.
+#define BENCH_ITERS_DEFAULT 200000
+
+// Virtual time each macro run covers, in ms.
+#define BENCH_RUN_MS_DEFAULT 10000
+
+// CPU frequency used for ROMs in macro runs.
+#define BENCH_CPU_FREQ_DEFAULT 2000
+
+// Nanoseconds on the host's monotonic clock.
+uint64_t bench_now_ns(void);
+
+// Starts a named array in the JSON output.
+void bench_begin(const char *section);
+void bench_end(void);
+
+// Adds a micro-benchmark result to the current array.
+void bench_result(const char *name, uint64_t ops, uint64_t ns);
+
+// Adds a macro run result to the current array.
+void bench_run_result(const char *name, uint64_t instrs, uint64_t idle_instrs,
+                      uint64_t frames, uint64_t ns);
+
+void bench_micro(long iters);
+void bench_macro(long run_ms, uint32_t cpu_freq, uint8_t quirks, bool profile,
+                 char **roms, int num_roms);
+
+// Virtual time used by macro runs in place of the hardware clock.
+void bench_clock_advance(uint32_t ms);
+
+// The virtual time as an emulator clock hook.
+uint32_t bench_clock(void *ctx);
+
+#endif
@@ -0,0 +1,29 @@
+#include "clock.h"
+
+#include "bench.h"
+
+/* The emulator is paced by its clock hook. Benchmarks drive it with virtual time so
+runs are repeatable and measure only the work done. */
+
+static uint32_t now_ms = 0;
+
+void clock_start(void) {
+    now_ms = 0;
+}
+
+uint64_t clock_us(void) {
+    return (uint64_t)now_ms * 1000;
+}
+
+uint32_t clock_get(void) {
+    return now_ms;
+}
+
+void bench_clock_advance(uint32_t ms) {
+    now_ms += ms;
+}
+
+uint32_t bench_clock(void *ctx) {
+    (void)ctx;
+    return now_ms;
+}
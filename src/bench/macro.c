@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+#include "clock.h"
+#include "display.h"
+#include "sd.h"
+
+// Scripted input: a key is pressed every KEY_PERIOD ms and held for KEY_HOLD ms.
+#define KEY_PERIOD 200
+#define KEY_HOLD 80
+
+typedef struct {
+    const char *name;
+    const uint8_t *rom;
+    size_t size;
+    uint8_t quirks;
+} PROGRAM;
+
+/* Bounces a lo-res sprite across the screen, one step per 2 delay timer ticks.
+Key 5 clears the screen. */
+static const uint8_t bounce_rom[] = {
+    0x60, 0x00,  // 200: LD V0, 0
+    0x61, 0x00,  // 202: LD V1, 0
+    0x69, 0x05,  // 204: LD V9, 5
+    0x68, 0x1F,  // 206: LD V8, 0x1F
+    0x67, 0x3F,  // 208: LD V7, 0x3F
+    0xA2, 0x30,  // 20A: LD I, 230
+    0xD0, 0x18,  // 20C: DRW V0, V1, 8
+    0x64, 0x02,  // 20E: LD V4, 2
+    0xF4, 0x15,  // 210: LD DT, V4
+    0xF4, 0x07,  // 212: LD V4, DT
+    0x34, 0x00,  // 214: SE V4, 0
+    0x12, 0x12,  // 216: JP 212
+    0xD0, 0x18,  // 218: DRW V0, V1, 8
+    0x70, 0x01,  // 21A: ADD V0, 1
+    0x80, 0x72,  // 21C: AND V0, V7
+    0x71, 0x01,  // 21E: ADD V1, 1
+    0x81, 0x82,  // 220: AND V1, V8
+    0xE9, 0x9E,  // 222: SKP V9
+    0x12, 0x0C,  // 224: JP 20C
+    0x00, 0xE0,  // 226: CLS
+    0x12, 0x0C,  // 228: JP 20C
+    0x00, 0x00,  // 22A
+    0x00, 0x00,  // 22C
+    0x00, 0x00,  // 22E
+    0x3C, 0x7E, 0xFF, 0xDB, 0xFF, 0x66, 0x3C, 0x18  // 230: Sprite
+};
+
+// Draws a row of big digits in hi-res, then scrolls it around, without waiting.
+static const uint8_t scroll_rom[] = {
+    0x00, 0xFF,  // 200: HIGH
+    0x60, 0x00,  // 202: LD V0, 0
+    0x61, 0x00,  // 204: LD V1, 0
+    0x62, 0x00,  // 206: LD V2, 0
+    0xF0, 0x30,  // 208: LD HF, V0
+    0xD1, 0x20,  // 20A: DRW V1, V2, 0
+    0x71, 0x10,  // 20C: ADD V1, 16
+    0x70, 0x01,  // 20E: ADD V0, 1
+    0x30, 0x0A,  // 210: SE V0, 10
+    0x12, 0x08,  // 212: JP 208
+    0x00, 0xC4,  // 214: SCD 4
+    0x00, 0xFB,  // 216: SCR
+    0x00, 0xD4,  // 218: SCU 4
+    0x00, 0xFC,  // 21A: SCL
+    0x00, 0xC2,  // 21C: SCD 2
+    0x60, 0x00,  // 21E: LD V0, 0
+    0x61, 0x00,  // 220: LD V1, 0
+    0x12, 0x08   // 222: JP 208
+};
+
+// Arithmetic, memory and subroutine calls with no drawing or waiting.
+static const uint8_t alu_rom[] = {
+    0x60, 0x00,  // 200: LD V0, 0
+    0x61, 0x01,  // 202: LD V1, 1
+    0xA3, 0x00,  // 204: LD I, 300
+    0x80, 0x14,  // 206: ADD V0, V1
+    0x81, 0x04,  // 208: ADD V1, V0
+    0x82, 0x03,  // 20A: XOR V2, V0
+    0x83, 0x16,  // 20C: SHR V3, V1
+    0xC4, 0xFF,  // 20E: RND V4, 0xFF
+    0xF4, 0x33,  // 210: LD B, V4
+    0xF2, 0x65,  // 212: LD V2, [I]
+    0x35, 0x00,  // 214: SE V5, 0
+    0x00, 0xE0,  // 216: CLS
+    0x22, 0x20,  // 218: CALL 220
+    0x12, 0x04,  // 21A: JP 204
+    0x00, 0x00,  // 21C
+    0x00, 0x00,  // 21E
+    0x76, 0x01,  // 220: ADD V6, 1
+    0x00, 0xEE   // 222: RET
+};
+
+/* Leans on the instructions S-CHIP quirks change (shifts, Fx55/Fx65, Bnnn and
+hi-res Dxyn) with no waiting. Only jumps back to its loop as S-CHIP. */
+static const uint8_t schip_rom[] = {
+    0x00, 0xFF,  // 200: HIGH
+    0x60, 0x00,  // 202: LD V0, 0
+    0x61, 0x00,  // 204: LD V1, 0
+    0x63, 0x01,  // 206: LD V3, 1
+    0xA2, 0x24,  // 208: LD I, 224
+    0xD0, 0x1F,  // 20A: DRW V0, V1, 15
+    0x82, 0x06,  // 20C: SHR V2
+    0x83, 0x0E,  // 20E: SHL V3
+    0x70, 0x05,  // 210: ADD V0, 5
+    0x71, 0x03,  // 212: ADD V1, 3
+    0xA3, 0x00,  // 214: LD I, 300
+    0xF3, 0x55,  // 216: LD [I], V3
+    0xF3, 0x65,  // 218: LD V3, [I]
+    0x62, 0x00,  // 21A: LD V2, 0
+    0xB2, 0x20,  // 21C: JP V2, 220
+    0x00, 0x00,  // 21E
+    0x73, 0x01,  // 220: ADD V3, 1
+    0x12, 0x08,  // 222: JP 208
+    0x18, 0x3C, 0x7E, 0xFF, 0xDB, 0xFF, 0x7E, 0x3C,  // 224: Sprite
+    0x18, 0x24, 0x42, 0x81, 0x42, 0x24, 0x18};
+
+static const PROGRAM programs[] = {
+    {"macro/bounce", bounce_rom, sizeof(bounce_rom), 0x00},
+    {"macro/scroll", scroll_rom, sizeof(scroll_rom), 0x00},
+    {"macro/alu", alu_rom, sizeof(alu_rom), 0x00},
+    {"macro/schip", schip_rom, sizeof(schip_rom), 0xFF},
+};
+
+static CHIP8 chip8;
+static uint8_t metadata[SD_BLOCK_SIZE];
+static const CHIP8_HOOKS hooks = {.clock = bench_clock};
+
+static void _press_keys(uint32_t t) {
+    static const uint8_t keys[] = {5, 4, 6, 2, 8, 5, 7, 1};
+    uint8_t key = keys[(t / KEY_PERIOD) % sizeof(keys)];
+
+    if (t % KEY_PERIOD == 0) {
+        chip8_press_keys(&chip8, 1 << key);
+    } else if (t % KEY_PERIOD == KEY_HOLD) {
+        chip8_release_keys(&chip8, 1 << key);
+    }
+}
+
+/* Plays a program the way the firmware does, one cycle per ms of virtual time,
+drawing the display whenever it is due. */
+static void _write_stderr(const char *str) {
+    fputs(str, stderr);
+}
+
+static void _run(const char *name, const uint8_t *rom, size_t size, uint8_t quirks,
+                 long run_ms, uint32_t cpu_freq, bool profile) {
+    bool q[NUM_QUIRKS];
+    for (int i = 0; i < NUM_QUIRKS; i++) {
+        q[i] = (quirks >> i) & 1;
+    }
+
+    clock_start();
+    chip8_init(&chip8, cpu_freq, TIMER_FREQ_DEFAULT, REFRESH_FREQ_DEFAULT,
+               PC_START_ADDR_DEFAULT, q, metadata, 0, &hooks);
+    chip8_load_font(&chip8);
+
+    memcpy(&chip8.RAM[PC_START_ADDR_DEFAULT], rom, size);
+    chip8_invalidate(&chip8, PC_START_ADDR_DEFAULT, size);
+
+    uint64_t frames = 0;
+    uint64_t start = bench_now_ns();
+
+    for (long t = 0; t < run_ms; t++) {
+        bench_clock_advance(1);
+        _press_keys(t);
+        chip8_cycle(&chip8);
+
+        if (chip8.display_updated) {
+            chip8_present(&chip8);
+#if CHIP8_PAGE_MAJOR
+            display_draw_pages(chip8.display, chip8.display_dirty);
+#else
+            display_draw(chip8.display, chip8.display_dirty);
+#endif
+            frames++;
+        }
+
+        if (chip8.exit) {
+            break;
+        }
+    }
+
+    bench_run_result(name, chip8.num_instrs, chip8.num_idle_instrs, frames,
+                     bench_now_ns() - start);
+
+#if CHIP8_PROFILE
+    if (profile) {
+        fprintf(stderr, "%s\n", name);
+        chip8_profile_dump(&chip8, _write_stderr);
+    }
+#else
+    (void)profile;
+    (void)_write_stderr;
+#endif
+}
+
+void bench_macro(long run_ms, uint32_t cpu_freq, uint8_t quirks, bool profile,
+                 char **roms, int num_roms) {
+    static uint8_t rom[MAX_RAM - PC_START_ADDR_DEFAULT];
+
+    bench_begin("macro");
+
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++) {
+        const PROGRAM *p = &programs[i];
+        _run(p->name, p->rom, p->size, p->quirks, run_ms, cpu_freq, profile);
+    }
+
+    for (int i = 0; i < num_roms; i++) {
+        FILE *f = fopen(roms[i], "rb");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", roms[i]);
+            continue;
+        }
+
+        size_t size = fread(rom, 1, sizeof(rom), f);
+        fclose(f);
+
+        _run(roms[i], rom, size, quirks, run_ms, cpu_freq, profile);
+    }
+
+    bench_end();
+}
@@ -0,0 +1,260 @@
+#include <string.h>
+
+#include "bench.h"
+#include "display.h"
+#include "sd.h"
+
+// Instructions executed between resets of PC and I, so neither runs off RAM.
+#define EXEC_CHUNK 256
+
+#define DATA_ADDR 0x300
+
+// A loop of up to 4 instructions, repeated from PC_START_ADDR_DEFAULT.
+typedef struct {
+    const char *name;
+    uint16_t instrs[4];
+    int num_instrs;
+} EXEC_CLASS;
+
+static const EXEC_CLASS exec_classes[] = {
+    {"execute/ld_byte", {0x6A12}, 1},
+    {"execute/add_byte", {0x7A01}, 1},
+    {"execute/alu", {0x8AB4}, 1},
+    {"execute/shift", {0x8AB6}, 1},
+    {"execute/skip", {0x3AFF}, 1},
+    {"execute/ld_i", {0xA300}, 1},
+    {"execute/add_i", {0xF01E}, 1},
+    {"execute/rnd", {0xCA0F}, 1},
+    {"execute/key", {0xEA9E}, 1},
+    {"execute/ld_dt", {0xFA07}, 1},
+    {"execute/bcd", {0xFA33}, 1},
+    {"execute/ld_mem", {0xF365}, 1},
+    {"execute/st_mem", {0xF355}, 1},
+    {"execute/jp", {0x1202, 0x1200}, 2},
+    {"execute/call_ret", {0x2204, 0x1200, 0x00EE}, 3},
+};
+
+typedef struct {
+    const char *name;
+    bool hires;
+    uint8_t n;
+    bool clip;
+} DRAW_CASE;
+
+static const DRAW_CASE draw_cases[] = {
+    {"draw/lores_8x5_wrap", false, 5, false},
+    {"draw/lores_8x15_wrap", false, 15, false},
+    {"draw/lores_16x16_wrap", false, 0, false},
+    {"draw/lores_8x5_clip", false, 5, true},
+    {"draw/lores_16x16_clip", false, 0, true},
+    {"draw/hires_8x5_wrap", true, 5, false},
+    {"draw/hires_8x15_wrap", true, 15, false},
+    {"draw/hires_16x16_wrap", true, 0, false},
+    {"draw/hires_8x5_clip", true, 5, true},
+    {"draw/hires_16x16_clip", true, 0, true},
+};
+
+typedef struct {
+    const char *name;
+    bool hires;
+    int xdir;
+    int ydir;
+    int num_pixels;
+} SCROLL_CASE;
+
+static const SCROLL_CASE scroll_cases[] = {
+    {"scroll/lores_down_4", false, 0, 1, 4},
+    {"scroll/lores_up_4", false, 0, -1, 4},
+    {"scroll/lores_right_4", false, 1, 0, 4},
+    {"scroll/lores_left_4", false, -1, 0, 4},
+    {"scroll/hires_down_4", true, 0, 1, 4},
+    {"scroll/hires_up_4", true, 0, -1, 4},
+    {"scroll/hires_right_4", true, 1, 0, 4},
+    {"scroll/hires_left_4", true, -1, 0, 4},
+};
+
+static CHIP8 chip8;
+static uint8_t metadata[SD_BLOCK_SIZE];
+static const CHIP8_HOOKS hooks = {.clock = bench_clock};
+static uint32_t seed = 1;
+
+// Small LCG so every run draws the same sprites in the same places.
+static uint8_t _rand(void) {
+    seed = (seed * 1103515245) + 12345;
+    return seed >> 16;
+}
+
+static void _reset(bool quirk_clip) {
+    bool quirks[NUM_QUIRKS] = {0};
+    quirks[5] = quirk_clip;
+
+    chip8_init(&chip8, 0, 0, 0, PC_START_ADDR_DEFAULT, quirks, metadata, 0, &hooks);
+    chip8_load_font(&chip8);
+
+    for (int i = 0; i < 64; i++) {
+        chip8.RAM[DATA_ADDR + i] = _rand();
+    }
+    chip8_invalidate(&chip8, DATA_ADDR, 64);
+}
+
+static void _fill_display(void) {
+    uint8_t *buf = (uint8_t *)chip8.display;
+    uint8_t *lores = (uint8_t *)chip8.lores;
+
+    for (size_t i = 0; i < sizeof(chip8.display); i++) {
+        buf[i] = _rand();
+    }
+
+    for (size_t i = 0; i < sizeof(chip8.lores); i++) {
+        lores[i] = _rand();
+    }
+}
+
+static void _bench_execute(const EXEC_CLASS *ec, long iters) {
+    _reset(false);
+
+    // Repeat the loop over enough RAM for a whole chunk
+    for (int i = 0; i < EXEC_CHUNK + 4; i++) {
+        uint16_t instr = ec->instrs[i % ec->num_instrs];
+        uint16_t addr = PC_START_ADDR_DEFAULT + (i * 2);
+
+        chip8.RAM[addr] = instr >> 8;
+        chip8.RAM[addr + 1] = instr & 0xFF;
+    }
+    chip8_invalidate(&chip8, PC_START_ADDR_DEFAULT, (EXEC_CHUNK + 4) * 2);
+
+    uint64_t start = bench_now_ns();
+
+    for (long done = 0; done < iters; done += EXEC_CHUNK) {
+        chip8.PC = PC_START_ADDR_DEFAULT;
+        chip8.SP = SP_START_ADDR;
+        chip8.I = DATA_ADDR;
+
+        for (int i = 0; i < EXEC_CHUNK; i++) {
+            chip8_execute(&chip8);
+        }
+    }
+
+    uint64_t ns = bench_now_ns() - start;
+    long ops = ((iters + EXEC_CHUNK - 1) / EXEC_CHUNK) * EXEC_CHUNK;
+    bench_result(ec->name, ops, ns);
+}
+
+static void _bench_draw(const DRAW_CASE *dc, long iters) {
+    static uint8_t pos[256][2];
+
+    _reset(dc->clip);
+    chip8.hires = dc->hires;
+    chip8.I = DATA_ADDR;
+    _fill_display();
+
+    // Anywhere on screen, edges included (out of bounds is wrapped or clipped)
+    for (int i = 0; i < 256; i++) {
+        pos[i][0] = _rand() % (dc->hires ? DISPLAY_WIDTH : DISPLAY_WIDTH / 2);
+        pos[i][1] = _rand() % (dc->hires ? DISPLAY_HEIGHT : DISPLAY_HEIGHT / 2);
+    }
+
+    uint64_t start = bench_now_ns();
+
+    for (long i = 0; i < iters; i++) {
+        chip8_draw(&chip8, pos[i & 0xFF][0], pos[i & 0xFF][1], dc->n);
+    }
+
+    bench_result(dc->name, iters, bench_now_ns() - start);
+}
+
+static void _bench_scroll(const SCROLL_CASE *sc, long iters) {
+    _reset(false);
+    chip8.hires = sc->hires;
+    _fill_display();
+
+    uint64_t start = bench_now_ns();
+
+    for (long i = 0; i < iters; i++) {
+        chip8_scroll(&chip8, sc->xdir, sc->ydir, sc->num_pixels);
+
+        // Keep something on screen to move
+        if ((i & 0x0F) == 0) {
+            chip8.I = DATA_ADDR;
+            chip8_draw(&chip8, 60, 28, 0);
+        }
+    }
+
+    bench_result(sc->name, iters, bench_now_ns() - start);
+}
+
+static void _draw_display(void) {
+#if CHIP8_PAGE_MAJOR
+    display_draw_pages(chip8.display, chip8.display_dirty);
+#else
+    display_draw(chip8.display, chip8.display_dirty);
+#endif
+}
+
+// Sends the whole display, or a single 8x8 band of it, to the LCD.
+static void _bench_display(const char *name, bool full, long iters) {
+    _reset(false);
+    _fill_display();
+
+    // The LCD is much slower than anything else, so it gets fewer iterations
+    iters = (iters / 100) + 1;
+    uint64_t start = bench_now_ns();
+
+    for (long i = 0; i < iters; i++) {
+        if (full) {
+            chip8_mark_display_dirty(&chip8);
+        } else {
+            chip8.display_dirty[i % DISPLAY_PAGES] = 1 << (i % 16);
+        }
+
+        _draw_display();
+    }
+
+    bench_result(name, iters, bench_now_ns() - start);
+}
+
+// Scales the whole lo-res plane, or a single 8x8 band of it, up to the display.
+static void _bench_present(const char *name, bool full, long iters) {
+    _reset(false);
+    _fill_display();
+
+    uint64_t start = bench_now_ns();
+
+    for (long i = 0; i < iters; i++) {
+        if (full) {
+            chip8_mark_display_dirty(&chip8);
+        } else {
+            // Nothing clears the dirty bands here, unlike drawing the display
+            memset(chip8.display_dirty, 0, sizeof(chip8.display_dirty));
+            chip8.display_dirty[i % DISPLAY_PAGES] = 1 << (i % 16);
+        }
+
+        chip8_present(&chip8);
+    }
+
+    bench_result(name, iters, bench_now_ns() - start);
+}
+
+void bench_micro(long iters) {
+    bench_begin("micro");
+
+    for (size_t i = 0; i < sizeof(exec_classes) / sizeof(exec_classes[0]); i++) {
+        _bench_execute(&exec_classes[i], iters);
+    }
+
+    for (size_t i = 0; i < sizeof(draw_cases) / sizeof(draw_cases[0]); i++) {
+        _bench_draw(&draw_cases[i], iters);
+    }
+
+    for (size_t i = 0; i < sizeof(scroll_cases) / sizeof(scroll_cases[0]); i++) {
+        _bench_scroll(&scroll_cases[i], iters);
+    }
+
+    _bench_present("present/full", true, iters);
+    _bench_present("present/band", false, iters);
+
+    _bench_display("display/full", true, iters);
+    _bench_display("display/band", false, iters);
+
+    bench_end();
+}
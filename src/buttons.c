@@ -5,6 +5,7 @@
 #include "led.h"
 
 #include "display.h"
+#include "idle.h"
 
 #define NVIC 0xE000E100
 #define NVIC_ISER0 (*((volatile uint32_t *)(NVIC + 0x00)))
@@ -50,7 +51,9 @@
 
 #define BOUNCE_WAIT 10  // Spec says 5ms max but really need twice that
 
-static int btn_status[NUM_BUTTONS] = {0};
+// Bit per button (see BTN_*_BIT): held down, and released but not yet read.
+static volatile uint8_t down_mask = 0;
+static volatile uint8_t released_mask = 0;
 static uint32_t last_press = 0;
 
 static int _get_btn_idx(enum Button btn) {
@@ -72,6 +75,18 @@ static int _get_btn_idx(enum Button btn) {
     return 0;
 }
 
+static void _press(int idx) {
+    down_mask |= (1 << idx);
+    released_mask &= ~(1 << idx);
+}
+
+static void _release(int idx) {
+    if (down_mask & (1 << idx)) {
+        down_mask &= ~(1 << idx);
+        released_mask |= (1 << idx);
+    }
+}
+
 static bool _btn_pressed_raw(enum Button btn) {
     return !(GPIOB_IDR & (1 << btn));  // Active-low logic
 }
@@ -80,9 +95,9 @@ static void _update_status(enum Button btn) {
     int idx = _get_btn_idx(btn);
 
     if (_btn_pressed_raw(btn))
-        btn_status[idx] = 1;
-    else if (btn_status[idx] == 1)
-        btn_status[idx] = 2;
+        _press(idx);
+    else
+        _release(idx);
 }
 
 static void _btn_interrupt(void) {
@@ -100,6 +115,7 @@ static void _btn_interrupt(void) {
         _update_status(pin);  // Pin maps to a Button
 
         last_press = clock_get();
+        idle_wake();
     }
 }
 
@@ -158,15 +174,21 @@ void buttons_init(void) {
 }
 
 bool btn_pressed(enum Button btn) {
-    return (btn_status[_get_btn_idx(btn)] == 1);
+    return down_mask & (1 << _get_btn_idx(btn));
 }
 
+/* Release bits are cleared atomically (LDREXB/STREXB), as the button
+ * interrupt may set another between reading and writing the mask. */
 bool btn_released(enum Button btn) {
-    int idx = _get_btn_idx(btn);
-    if (btn_status[idx] == 2) {
-        btn_status[idx] = 0;
-        return true;
-    }
+    uint8_t bit = 1 << _get_btn_idx(btn);
+
+    return __atomic_fetch_and(&released_mask, (uint8_t)~bit, __ATOMIC_RELAXED) & bit;
+}
+
+uint8_t btn_pressed_mask(void) {
+    return down_mask;
+}
 
-    return false;
+uint8_t btn_released_mask(void) {
+    return __atomic_exchange_n(&released_mask, 0, __ATOMIC_RELAXED);
 }
@@ -0,0 +1,97 @@
+#include "cartridge.h"
+
+#include <string.h>
+
+#include "sd.h"
+
+#define TITLE_IDX 1
+#define CPU_FREQ_IDX 12
+#define TIMER_FREQ_IDX 16
+#define REFRESH_FREQ_IDX 17
+#define QUIRKS_IDX 18
+#define BTN_MAPS_IDX 19
+#define REPLAY_BLOCK_IDX 47
+#define SCHEDULER_IDX 48
+#define EXT_IDX 49
+
+// Button key masks the firmware used before it read them from the cartridge.
+static const uint16_t default_btn_maps[NUM_BUTTONS] = {0x90, 0x240, 0x20, 0x100, 0x00, 0x40};
+
+// Whether the bytes from REPLAY_BLOCK_IDX on were written by this layout.
+static bool _has_ext(const uint8_t *block) {
+    return block[EXT_IDX] == CARTRIDGE_EXT_MAGIC && block[EXT_IDX + 1] == CARTRIDGE_EXT_VERSION;
+}
+
+bool cartridge_parse(const uint8_t *block, CARTRIDGE_META *meta) {
+    if (block[0] != CARTRIDGE_MAGIC) {
+        return false;
+    }
+
+    memcpy(meta->title, &block[TITLE_IDX], CARTRIDGE_TITLE_LEN);
+    meta->title[CARTRIDGE_TITLE_LEN] = '\0';
+
+    meta->cpu_freq = ((uint32_t)block[CPU_FREQ_IDX] << 24) | (block[CPU_FREQ_IDX + 1] << 16) |
+                     (block[CPU_FREQ_IDX + 2] << 8) | block[CPU_FREQ_IDX + 3];
+    meta->timer_freq = block[TIMER_FREQ_IDX];
+    meta->refresh_freq = block[REFRESH_FREQ_IDX];
+
+    for (int i = 0; i < NUM_QUIRKS; i++) {
+        meta->quirks[i] = (block[QUIRKS_IDX] >> i) & 1;
+    }
+
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        meta->btn_maps[i] = (block[BTN_MAPS_IDX + (i * 2)] << 8) | block[BTN_MAPS_IDX + (i * 2) + 1];
+    }
+
+    /* Without the marker, byte 47 is whatever was left on the card, which
+    could cut the ROM short. Anything outside the slot's ROM blocks can't be a
+    recording either. */
+    meta->replay_block = _has_ext(block) ? block[REPLAY_BLOCK_IDX] : 0;
+    if (meta->replay_block > CARTRIDGE_ROM_BLOCKS) {
+        meta->replay_block = 0;
+    }
+
+    // Unmarked, a stray 1 would quietly switch the scheduler
+    meta->frame_sliced = _has_ext(block) && block[SCHEDULER_IDX] == 1;
+
+    return true;
+}
+
+void cartridge_default(CARTRIDGE_META *meta) {
+    meta->title[0] = '\0';
+    meta->cpu_freq = CPU_FREQ_DEFAULT;
+    meta->timer_freq = TIMER_FREQ_DEFAULT;
+    meta->refresh_freq = REFRESH_FREQ_DEFAULT;
+    memset(meta->quirks, 0, sizeof(meta->quirks));
+    memcpy(meta->btn_maps, default_btn_maps, sizeof(default_btn_maps));
+    meta->replay_block = 0;
+    meta->frame_sliced = false;
+}
+
+void cartridge_set_replay_block(uint8_t *block, CARTRIDGE_META *meta, uint8_t replay_block) {
+    block[REPLAY_BLOCK_IDX] = replay_block;
+    block[SCHEDULER_IDX] = meta->frame_sliced;  // Was left as it was if unmarked
+    block[EXT_IDX] = CARTRIDGE_EXT_MAGIC;
+    block[EXT_IDX + 1] = CARTRIDGE_EXT_VERSION;
+    meta->replay_block = replay_block;
+}
+
+uint8_t cartridge_rom_blocks(const uint8_t *rom, int size) {
+    while (size > 0 && !rom[size - 1]) {
+        size--;
+    }
+
+    return (size + SD_BLOCK_SIZE - 1) / SD_BLOCK_SIZE;
+}
+
+uint16_t cartridge_btns_to_keys(const CARTRIDGE_META *meta, uint8_t btns) {
+    uint16_t keys = 0;
+
+    for (int i = 0; btns; i++, btns >>= 1) {
+        if (btns & 1) {
+            keys |= meta->btn_maps[i];
+        }
+    }
+
+    return keys;
+}
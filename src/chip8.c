@@ -1,33 +1,63 @@
 #include "chip8.h"
 
-#include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 
-#include "clock.h"
-#include "sd.h"
+#include "cycles.h"
+
+static const CHIP8OP *_bind_ops(uint8_t quirks);
 
 void chip8_init(CHIP8 *chip8, unsigned long cpu_freq, unsigned long timer_freq,
                 unsigned long refresh_freq, uint16_t pc_start_addr,
-                bool quirks[], uint8_t *metadata, uint8_t rom_num) {
-    // Seed for the RND instruction.
-    srand(69);
+                const bool quirks[], uint8_t *metadata, uint8_t rom_num,
+                const CHIP8_HOOKS *hooks) {
+    chip8->hooks = *hooks;
+    chip8_seed(chip8, RAND_SEED_DEFAULT);
 
+    uint8_t quirk_bits = 0;
     for (int i = 0; i < NUM_QUIRKS; i++) {
-        chip8->quirks[i] = quirks[i];
+        quirk_bits |= quirks[i] << i;
     }
+    chip8_set_quirks(chip8, quirk_bits);
 
     chip8_set_cpu_freq(chip8, cpu_freq);
+    chip8_set_cpu_catchup(chip8, CPU_CATCHUP_DEFAULT);
     chip8_set_timer_freq(chip8, timer_freq);
+    chip8_set_timer_ticks(chip8, false);
     chip8_set_refresh_freq(chip8, refresh_freq);
 
     chip8->pc_start_addr = pc_start_addr;
 
     chip8_reset(chip8);
 
+#if CHIP8_PROFILE
+    cycles_init();
+#endif
+
     chip8->metadata = metadata;
     chip8->rom_num = rom_num;
 }
 
+void chip8_set_quirks(CHIP8 *chip8, uint8_t quirks) {
+    chip8->quirks = quirks;
+    chip8->ops = _bind_ops(quirks);
+}
+
+void chip8_seed(CHIP8 *chip8, uint32_t seed) {
+    chip8->rand_state = seed ? seed : RAND_SEED_DEFAULT;
+}
+
+// Next byte of the instance's xorshift32 generator.
+static uint8_t _xorshift(CHIP8 *chip8) {
+    uint32_t x = chip8->rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rand_state = x;
+
+    return x >> 24;
+}
+
 void chip8_reset(CHIP8 *chip8) {
     chip8->PC = chip8->pc_start_addr;
     chip8->SP = SP_START_ADDR;
@@ -35,9 +65,9 @@ void chip8_reset(CHIP8 *chip8) {
     chip8->DT = 0;
     chip8->ST = 0;
 
-    chip8->prev_cycle_start = clock_get();
-    chip8->cur_cycle_start = clock_get();
-    chip8->cpu_cum = 0;
+    chip8->prev_cycle_start = chip8->hooks.clock(chip8->hooks.ctx);
+    chip8->cur_cycle_start = chip8->prev_cycle_start;
+    chip8->cpu_debt = 0;
     chip8->sound_cum = 0;
     chip8->delay_cum = 0;
 
@@ -45,7 +75,18 @@ void chip8_reset(CHIP8 *chip8) {
     chip8->beep = false;
     chip8->exit = false;
     chip8->hires = false;
-
+    chip8->stop = CHIP8_STOP_NONE;
+    chip8->num_instrs = 0;
+    chip8->idle = CHIP8_IDLE_NONE;
+    chip8->num_idle_instrs = 0;
+    chip8->num_traps = 0;
+    chip8->last_trap = 0;
+
+#if CHIP8_PROFILE
+    chip8_profile_reset(chip8);
+#endif
+
+    chip8_invalidate(chip8, 0, MAX_RAM);
     chip8_reset_registers(chip8);
     chip8_reset_keypad(chip8);
     chip8_reset_display(chip8);
@@ -60,18 +101,21 @@ void chip8_reset(CHIP8 *chip8) {
 
 void chip8_set_cpu_freq(CHIP8 *chip8, unsigned long cpu_freq) {
     chip8->cpu_freq = cpu_freq;
+    chip8->cpu_debt = 0;
+}
 
-    if (cpu_freq > 0) {
-        chip8->cpu_max_cum = ONE_SEC / chip8->cpu_freq;
-    }
+void chip8_set_cpu_catchup(CHIP8 *chip8, unsigned long cpu_catchup) {
+    chip8->cpu_catchup = cpu_catchup;
 }
 
 void chip8_set_timer_freq(CHIP8 *chip8, unsigned long timer_freq) {
     chip8->timer_freq = timer_freq;
+}
 
-    if (timer_freq > 0) {
-        chip8->timer_max_cum = ONE_SEC / chip8->timer_freq;
-    }
+void chip8_set_timer_ticks(CHIP8 *chip8, bool timer_ticks) {
+    chip8->timer_ticks = timer_ticks;
+    chip8->delay_cum = 0;
+    chip8->sound_cum = 0;
 }
 
 void chip8_set_refresh_freq(CHIP8 *chip8, unsigned long refresh_freq) {
@@ -128,6 +172,7 @@ void chip8_load_font(CHIP8 *chip8) {
     };
 
     memcpy(chip8->RAM + FONT_START_ADDR, font_data, sizeof(font_data));
+    chip8_invalidate(chip8, FONT_START_ADDR, sizeof(font_data));
 }
 
 /*bool chip8_load_rom(CHIP8 *chip8)
@@ -158,472 +203,808 @@ void chip8_load_font(CHIP8 *chip8) {
     return true;
 }*/
 
-bool chip8_cycle(CHIP8 *chip8) {
+/* Executes the instructions owed, or as many as the CPU gets through before it
+goes idle. Returns true if any were executed. */
+static bool _run_owed(CHIP8 *chip8, uint32_t owed) {
     bool executed = false;
-    chip8_update_elapsed_time(chip8);
 
-    // Slow the CPU down to match given CPU frequency.
-    chip8->cpu_cum += chip8->total_cycle_time;
-    if (!chip8->cpu_freq || chip8->cpu_cum >= chip8->cpu_max_cum) {
-        chip8->cpu_cum = 0;
-        chip8_execute(chip8);
+    while (owed > 0 && !chip8->idle) {
+        uint32_t start = chip8->num_instrs;
+        CHIP8_STOP stop = chip8_run(chip8, owed);
+
+        owed -= chip8->num_instrs - start;
         executed = true;
+
+        if (stop == CHIP8_STOP_EXIT) {
+            owed = 0;
+        }
+    }
+
+    // An idle CPU would only spin in place for the rest of what it owes, so skip it.
+    if (chip8->idle) {
+        chip8->num_idle_instrs += owed;
+    }
+
+    // Releases last one frame, once the CPU has had a chance to see them.
+    if (executed || chip8->idle) {
+        chip8->keys_released = 0;
+    }
+
+    return executed;
+}
+
+bool chip8_cycle(CHIP8 *chip8) {
+    uint32_t owed = CPU_BATCH_UNTHROTTLED;
+    chip8_update_elapsed_time(chip8);
+
+    /* Slow the CPU down to match given CPU frequency. Every elapsed ms owes
+    cpu_freq / ONE_SEC instructions. The fraction of an instruction that
+    isn't owed yet is carried over in cpu_debt, so any frequency works. */
+    if (chip8->cpu_freq) {
+        uint32_t elapsed = chip8->total_cycle_time;
+        if (elapsed > chip8->cpu_catchup) {
+            elapsed = chip8->cpu_catchup;
+        }
+
+        chip8->cpu_debt += elapsed * chip8->cpu_freq;
+        owed = chip8->cpu_debt / ONE_SEC;
+        chip8->cpu_debt %= ONE_SEC;
     }
 
+    bool executed = _run_owed(chip8, owed);
+
     chip8_handle_timers(chip8);
     return executed;
 }
 
-void chip8_execute(CHIP8 *chip8) {
-    /* Fetch */
-    // The first and second byte of instruction respectively.
-    uint8_t b1 = chip8->RAM[chip8->PC],
-            b2 = chip8->RAM[chip8->PC + 1];
+bool chip8_frame(CHIP8 *chip8) {
+    uint32_t owed = CPU_BATCH_UNTHROTTLED;
+    uint32_t frame_freq = chip8->timer_freq ? chip8->timer_freq : TIMER_FREQ_DEFAULT;
 
-    /* Decode */
-    // The code (first 4 bits) of instruction.
-    uint8_t c = b1 >> 4;
+    // Every frame owes cpu_freq / frame_freq instructions, the fraction carried in cpu_debt.
+    if (chip8->cpu_freq) {
+        chip8->cpu_debt += chip8->cpu_freq;
+        owed = chip8->cpu_debt / frame_freq;
+        chip8->cpu_debt %= frame_freq;
+    }
 
-    // The last 12 bits of instruction.
-    uint16_t nnn = ((b1 & 0xF) << 8) | b2;
+    bool executed = _run_owed(chip8, owed);
 
-    // The last 4 bits of instruction.
-    uint8_t n = b2 & 0xF;
+    chip8_tick_timers(chip8);
+    chip8->display_updated = true;
 
-    // The last 4 bits of first byte of instruction.
-    uint8_t x = b1 & 0xF;
+    return executed;
+}
 
-    // The first 4 bits of second byte of instruction.
-    uint8_t y = b2 >> 4;
+/* Handlers that depend on quirks are written once, inlined into a generic
+handler that tests chip8->quirks and into one for each quirk set that has the
+quirks as constants (see the handler tables). */
+#define ALWAYS_INLINE inline __attribute__((always_inline))
 
-    // The last 8 bits of instruction.
-    uint8_t kk = b2;
+static ALWAYS_INLINE void _draw(CHIP8 *chip8, uint8_t x, uint8_t y, uint8_t n, uint8_t quirks);
 
-    /* Immediately set PC to next instruction
-    after fetching and decoding the current one. */
-    chip8->PC += 2;
+/* Trap
+   Any instruction the interpreter doesn't know. It is skipped. */
+static void _op_trap(CHIP8 *chip8, const CHIP8I *in) {
+    (void)in;
 
-    /* Execute */
-    switch (c) {
-        case 0x00:
-            switch (b2) {
-                /* HALT (0000)
-                   Halt the emulator. */
-                case 0x00:
-                    chip8->PC -= 2;
-                    break;
-
-                /* CLS (00E0)
-                   Clear the display. */
-                case 0xE0:
-                    chip8_reset_display(chip8);
-                    break;
-
-                /* RET (00EE):
-                   Return from a subroutine. */
-                case 0xEE:
-                    chip8->PC = (chip8->RAM[chip8->SP] << 8);
-                    chip8->PC |= chip8->RAM[chip8->SP + 1];
-                    chip8->SP -= 2;
-                    break;
-
-                /* SCRR (00FB) (S-CHIP Only):
-                   Scroll the display right by 4 pixels. */
-                case 0xFB:
-                    chip8_scroll(chip8, 1, 0, 4);
-                    break;
-
-                /* SCRL (00FC) (S-CHIP Only):
-                   Scroll the display left by 4 pixels. */
-                case 0xFC:
-                    chip8_scroll(chip8, -1, 0, 4);
-                    break;
-
-                /* EXIT (00FD) (S-CHIP Only):
-                   Exit the interpreter. */
-                case 0xFD:
-                    chip8->exit = true;
-                    break;
-
-                /* LORES (00FE) (S-CHIP Only):
-                   Disable HI-RES mode. */
-                case 0xFE:
-                    chip8->hires = false;
-
-                    if (!chip8->quirks[4]) {
-                        chip8_reset_display(chip8);
-                    }
-
-                    break;
-
-                /* HIRES (00FF) (S-CHIP Only):
-                   Enable HI-RES mode. */
-                case 0xFF:
-                    chip8->hires = true;
-
-                    if (!chip8->quirks[4]) {
-                        chip8_reset_display(chip8);
-                    }
-
-                    break;
-
-                default:
-                    switch (y) {
-                        /* SCRD (00Cn) (S-CHIP Only):
-                           Scroll the display down by n pixels. */
-                        case 0xC:
-                            chip8_scroll(chip8, 0, 1, n);
-                            break;
-
-                        /* SCRU (00Dn) (S-CHIP Only):
-                           Scroll the display up by n pixels. */
-                        case 0xD:
-                            chip8_scroll(chip8, 0, -1, n);
-                            break;
-                    }
-
-                    break;
-            }
+    chip8->num_traps++;
+    chip8->last_trap = (chip8->RAM[chip8->PC - 2] << 8) | chip8->RAM[chip8->PC - 1];
+}
 
-            break;
+/* Decode
+   Placed in the decode cache for instructions that haven't been decoded yet
+   (or were overwritten). Decodes the instruction into the cache, then
+   executes it. */
+static void _op_decode(CHIP8 *chip8, const CHIP8I *in) {
+    (void)in;
+
+#if CHIP8_DECODE_CACHE
+    uint16_t addr = (chip8->PC - 2) & (MAX_RAM - 1);
+    CHIP8I *entry = &chip8->decoded[addr >> 1];
+
+    chip8_decode(chip8->RAM[addr], chip8->RAM[addr + 1], entry);
+    chip8->ops[entry->op](chip8, entry);
+#else
+    (void)chip8;
+#endif
+}
 
-        /* JP addr (1nnn)
-           Jump to location nnn. */
-        case 0x01:
-            chip8->PC = nnn;
-            break;
+/* HALT (0000)
+   Halt the emulator. */
+static void _op_halt(CHIP8 *chip8, const CHIP8I *in) {
+    (void)in;
 
-        /* CALL addr (2nnn)
-           Call subroutine at nnn. */
-        case 0x02:
-            chip8->SP += 2;
-            chip8->RAM[chip8->SP] = chip8->PC >> 8;
-            chip8->RAM[chip8->SP + 1] = chip8->PC & 0x00FF;
-            chip8->PC = nnn;
-            break;
+    chip8->PC -= 2;
+    chip8->stop = CHIP8_STOP_HALT;
+    chip8->idle = CHIP8_IDLE_KEY;
+}
 
-        /* SE Vx, byte (3xkk)
-           Skip next instruction if Vx = kk. */
-        case 0x03:
-            if (chip8->V[x] == kk) {
-                chip8_skip_instr(chip8);
-            }
+/* SCD n (00Cn) (S-CHIP Only):
+   Scroll the display down by n pixels. */
+static void _op_scd(CHIP8 *chip8, const CHIP8I *in) {
+    chip8_scroll(chip8, 0, 1, CHIP8I_N(in));
+    chip8->stop = CHIP8_STOP_DISPLAY;
+}
 
-            break;
+/* SCU n (00Dn) (S-CHIP Only):
+   Scroll the display up by n pixels. */
+static void _op_scu(CHIP8 *chip8, const CHIP8I *in) {
+    chip8_scroll(chip8, 0, -1, CHIP8I_N(in));
+    chip8->stop = CHIP8_STOP_DISPLAY;
+}
 
-        /* SNE Vx, byte (4xkk)
-           Skip next instruction if Vx != kk. */
-        case 0x04:
-            if (chip8->V[x] != kk) {
-                chip8_skip_instr(chip8);
-            }
+/* CLS (00E0)
+   Clear the display. */
+static void _op_cls(CHIP8 *chip8, const CHIP8I *in) {
+    (void)in;
 
-            break;
+    chip8_reset_display(chip8);
+    chip8->stop = CHIP8_STOP_DISPLAY;
+}
 
-        case 0x05:
-            switch (n) {
-                /* SE Vx, Vy (5xy0)
-                   Skip next instruction if Vx = Vy. */
-                case 0x0:
-                    if (chip8->V[x] == chip8->V[y]) {
-                        chip8_skip_instr(chip8);
-                    }
+/* RET (00EE):
+   Return from a subroutine. */
+static void _op_ret(CHIP8 *chip8, const CHIP8I *in) {
+    (void)in;
 
-                    break;
-            }
+    chip8->PC = (chip8->RAM[chip8->SP] << 8);
+    chip8->PC |= chip8->RAM[chip8->SP + 1];
+    chip8->SP -= 2;
+}
 
-            break;
+/* SCR (00FB) (S-CHIP Only):
+   Scroll the display right by 4 pixels. */
+static void _op_scr(CHIP8 *chip8, const CHIP8I *in) {
+    (void)in;
 
-        /* LD Vx, byte (6xkk)
-           Set Vx = kk. */
-        case 0x06:
-            chip8->V[x] = kk;
-            break;
+    chip8_scroll(chip8, 1, 0, 4);
+    chip8->stop = CHIP8_STOP_DISPLAY;
+}
 
-        /* ADD Vx, byte (7xkk)
-           Set Vx = Vx + kk. */
-        case 0x07:
-            chip8->V[x] += kk;
-            break;
+/* SCL (00FC) (S-CHIP Only):
+   Scroll the display left by 4 pixels. */
+static void _op_scl(CHIP8 *chip8, const CHIP8I *in) {
+    (void)in;
 
-        case 0x08:
-            switch (n) {
-                /* LD Vx, Vy (8xy0)
-                   Set Vx = Vy. */
-                case 0x00:
-                    chip8->V[x] = chip8->V[y];
-                    break;
-
-                /* OR Vx, Vy (8xy1)
-                   Set Vx = Vx OR Vy. */
-                case 0x01:
-                    chip8->V[x] |= chip8->V[y];
-                    break;
-
-                /* AND Vx, Vy (8xy2)
-                   Set Vx = Vx AND Vy. */
-                case 0x02:
-                    chip8->V[x] &= chip8->V[y];
-                    break;
-
-                /* XOR Vx, Vy (8xy3)
-                   Set Vx = Vx XOR Vy. */
-                case 0x03:
-                    chip8->V[x] ^= chip8->V[y];
-                    break;
-
-                /* ADD Vx, Vy (8xy4)
-                   Set Vx = Vx + Vy, set VF = carry. */
-                case 0x04: {
-                    bool carry = ((chip8->V[x] + chip8->V[y]) > 0xFF);
-                    chip8->V[x] += chip8->V[y];
-                    chip8->V[0x0F] = carry;
-                    break;
-                }
+    chip8_scroll(chip8, -1, 0, 4);
+    chip8->stop = CHIP8_STOP_DISPLAY;
+}
 
-                /* SUB Vx, Vy (8xy5)
-                   Set Vx = Vx - Vy, set VF = NOT borrow. */
-                case 0x05: {
-                    bool no_borrow = (chip8->V[x] >= chip8->V[y]);
-                    chip8->V[x] = chip8->V[x] - chip8->V[y];
-                    chip8->V[0x0F] = no_borrow;
-                    break;
-                }
+/* EXIT (00FD) (S-CHIP Only):
+   Exit the interpreter. */
+static void _op_exit(CHIP8 *chip8, const CHIP8I *in) {
+    (void)in;
 
-                /* SHR Vx {, Vy} (8xy6)
-                   Legacy: Set Vx = Vy SHR 1.
-                   S-CHIP: Set Vx = Vx SHR 1. */
-                case 0x06:
-                    if (!chip8->quirks[0]) {
-                        chip8->V[x] = chip8->V[y];
-                    }
-
-                    chip8->V[0x0F] = chip8->V[x] & 0x01;
-                    chip8->V[x] >>= 1;
-                    break;
-
-                /* SUBN Vx, Vy (8xy7)
-                   Set Vx = Vy - Vx, set VF = NOT borrow. */
-                case 0x07: {
-                    bool no_borrow = (chip8->V[y] >= chip8->V[x]);
-                    chip8->V[x] = chip8->V[y] - chip8->V[x];
-                    chip8->V[0x0F] = no_borrow;
-                    break;
-                }
+    chip8->exit = true;
+    chip8->stop = CHIP8_STOP_EXIT;
+}
 
-                /* SHL Vx {, Vy} (8xyE)
-                   Legacy: Set Vx = Vy SHL 1.
-                   S-CHIP: Set Vx = Vx SHL 1. */
-                case 0x0E:
-                    if (!chip8->quirks[0]) {
-                        chip8->V[x] = chip8->V[y];
-                    }
-
-                    chip8->V[0x0F] = (chip8->V[x] & 0x80) >> 7;
-                    chip8->V[x] <<= 1;
-                    break;
-            }
+/* LOW (00FE) (S-CHIP Only):
+   Disable HI-RES mode. */
+static ALWAYS_INLINE void _low(CHIP8 *chip8, const CHIP8I *in, uint8_t quirks) {
+    (void)in;
 
-            break;
+    if (quirks & QUIRK_KEEP_DISPLAY) {
+        chip8_set_hires(chip8, false);
+    } else {
+        chip8->hires = false;
+        chip8_reset_display(chip8);
+    }
 
-        /* SNE Vx, Vy (9xy0)
-           Skip next instruction if Vx != Vy. */
-        case 0x09:
-            if (chip8->V[x] != chip8->V[y]) {
-                chip8_skip_instr(chip8);
-            }
+    chip8->stop = CHIP8_STOP_DISPLAY;
+}
 
-            break;
+/* HIGH (00FF) (S-CHIP Only):
+   Enable HI-RES mode. */
+static ALWAYS_INLINE void _high(CHIP8 *chip8, const CHIP8I *in, uint8_t quirks) {
+    (void)in;
 
-        /* LD I, addr (Annn)
-           Set I = nnn. */
-        case 0x0A:
-            chip8->I = nnn;
-            break;
+    if (quirks & QUIRK_KEEP_DISPLAY) {
+        chip8_set_hires(chip8, true);
+    } else {
+        chip8->hires = true;
+        chip8_reset_display(chip8);
+    }
 
-        /* JP V0, addr (Bnnn)
-           Legacy: Jump to location nnn + V0.
-           S-CHIP: Jump to location nnn + Vx. */
-        case 0x0B:
-            chip8->PC = (!chip8->quirks[2]) ? chip8->V[0] + nnn : chip8->V[x] + nnn;
-            break;
+    chip8->stop = CHIP8_STOP_DISPLAY;
+}
 
-        /* RND Vx, byte (Cxkk)
-           Set Vx = random byte AND kk. */
-        case 0x0C:
-            chip8->V[x] = (rand() % 0x100) & kk;
-            break;
+/* Checks if a jump from address from closes a loop that can't do anything
+until a timer or key event: a jump to itself, or a delay timer poll of the form
+Fx07, 3x00, 1nnn (back to the Fx07). */
+static void _detect_idle(CHIP8 *chip8, uint16_t from) {
+    uint16_t to = chip8->PC;
+
+    if (to == from) {
+        chip8->idle = CHIP8_IDLE_KEY;
+        chip8->stop = CHIP8_STOP_IDLE;
+    } else if (to + 4 == from && chip8->DT > 0) {
+        const uint8_t *loop = &chip8->RAM[to];
+        uint8_t x = loop[0] & 0x0F;
+
+        if (loop[0] == (0xF0 | x) && loop[1] == 0x07 && loop[2] == (0x30 | x) && loop[3] == 0x00) {
+            chip8->idle = CHIP8_IDLE_TIMER;
+            chip8->stop = CHIP8_STOP_IDLE;
+        }
+    }
+}
 
-        /* DRW Vx, Vy, n (Dxyn):
-           Legacy: Display n-byte sprite starting at memory location I at (Vx, Vy),
-           set VF = collision.
-           S-CHIP: If hires=false: If n=0, display 8x16 sprite. Else:
-           Same as Legacy. If hires=true: Same as Legacy, except
-           set VF = num rows collision. If n=0: Display 16x16 sprite starting at
-           memory location I at (Vx, Vy), set VF = num rows collision. */
-        case 0x0D:
-            chip8_draw(chip8, chip8->V[x], chip8->V[y], n);
-            break;
+/* JP addr (1nnn)
+   Jump to location nnn. */
+static void _op_jp(CHIP8 *chip8, const CHIP8I *in) {
+    uint16_t from = chip8->PC - 2;
 
-        case 0x0E:
-            switch (b2) {
-                /* SKP Vx (Ex9E)
-                   Skip next instruction if key with the value of Vx is pressed. */
-                case 0x9E:
-                    if (chip8->keypad[chip8->V[x]] == KEY_DOWN) {
-                        chip8_skip_instr(chip8);
-                    }
-
-                    break;
-
-                /* SKNP Vx (ExA1)
-                   Skip next instruction if key with the value of Vx is not pressed. */
-                case 0xA1:
-                    if (chip8->keypad[chip8->V[x]] == KEY_UP) {
-                        chip8_skip_instr(chip8);
-                    }
-
-                    break;
-            }
+    chip8->PC = CHIP8I_NNN(in);
 
-            break;
+    // Only a jump backwards can close an idle loop.
+    if (chip8->PC <= from) {
+        _detect_idle(chip8, from);
+    }
+}
 
-        case 0x0F:
-            switch (b2) {
-                /* LD Vx, DT (Fx07)
-                   Set Vx = delay timer value. */
-                case 0x07:
-                    chip8->V[x] = chip8->DT;
-                    break;
-
-                /* LD Vx, K (Fx0A)
-                   Wait for a key press, store the value of the key in Vx. */
-                case 0x0A: {
-                    chip8_wait_key(chip8, x);
-                    break;
-                }
+/* CALL addr (2nnn)
+   Call subroutine at nnn. */
+static void _op_call(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->SP += 2;
+    chip8->RAM[chip8->SP] = chip8->PC >> 8;
+    chip8->RAM[chip8->SP + 1] = chip8->PC & 0x00FF;
+    chip8_invalidate(chip8, chip8->SP, 2);
+    chip8->PC = CHIP8I_NNN(in);
+}
 
-                /* LD DT, Vx (Fx15)
-                   Set delay timer = Vx. */
-                case 0x15:
-                    chip8->DT = chip8->V[x];
-                    break;
-
-                /* LD ST, Vx (Fx18)
-                   Set sound timer = Vx. */
-                case 0x18:
-                    chip8->ST = chip8->V[x];
-                    break;
-
-                /* ADD I, Vx (Fx1E):
-                   Set I = I + Vx. */
-                case 0x1E:
-                    chip8->I += chip8->V[x];
-                    break;
-
-                /* LD F, Vx (Fx29)
-                   Set I = location of 5-byte sprite for digit Vx. */
-                case 0x29:
-                    chip8->I = FONT_START_ADDR + (chip8->V[x] * 0x05);
-                    break;
-
-                /* LD HF, Vx (Fx30) (S-CHIP Only)
-                   Set I = location of 10-byte sprite for digit Vx. */
-                case 0x30:
-                    chip8->I = BIG_FONT_START_ADDR + (chip8->V[x] * 0x0A);
-                    break;
-
-                /* LD B, Vx (Fx33)
-                   Store BCD representation of Vx in memory locations:
-                   I, I+1, and I+2. */
-                case 0x33:
-                    chip8->RAM[chip8->I] = (chip8->V[x] / 100) % 10;
-                    chip8->RAM[chip8->I + 1] = (chip8->V[x] / 10) % 10;
-                    chip8->RAM[chip8->I + 2] = chip8->V[x] % 10;
-                    break;
-
-                /* LD [I], Vx (Fx55)
-                   Store registers V0 through Vx in memory starting at location I.
-                   Legacy: Set I=I+x+1 */
-                case 0x55:
-                    for (int r = 0; r <= x; r++) {
-                        chip8->RAM[chip8->I + r] = chip8->V[r];
-                    }
-
-                    if (!chip8->quirks[1]) {
-                        chip8->I += (x + 1);
-                    }
-
-                    break;
-
-                /* LD Vx, [I] (Fx65)
-                   Read registers V0 through Vx from memory starting at location I.
-                   Legacy: Set I=I+x+1 */
-                case 0x65:
-                    for (int r = 0; r <= x; r++) {
-                        chip8->V[r] = chip8->RAM[chip8->I + r];
-                    }
-
-                    if (!chip8->quirks[1]) {
-                        chip8->I += (x + 1);
-                    }
-
-                    break;
-
-                /* LD uflags_disk, V0..Vx (Fx75) (S-CHIP Only)
-                   Save user flags to disk. */
-                case 0x75:
-                    /*if (!chip8_handle_user_flags(chip8, x + 1, true))
-                    {
-                        fprintf(stderr, "Unable to save user flags to %s\n",
-                                chip8->UF_path);
-                    }*/
-
-                    chip8_handle_user_flags(chip8, x + 1, true);
-                    break;
-
-                /* LD V0..Vx, uflags_disk (Fx85) (S-CHIP Only)
-                   Load user flags from disk. */
-                case 0x85:
-                    /*if (!chip8_handle_user_flags(chip8, x + 1, false))
-                    {
-                        fprintf(stderr, "Unable to load user flags from %s\n",
-                                chip8->UF_path);
-                    }*/
-
-                    chip8_handle_user_flags(chip8, x + 1, false);
-                    break;
-            }
+/* SE Vx, byte (3xkk)
+   Skip next instruction if Vx = kk. */
+static void _op_se_byte(CHIP8 *chip8, const CHIP8I *in) {
+    if (chip8->V[in->x] == in->kk) {
+        chip8_skip_instr(chip8);
+    }
+}
 
-            break;
+/* SNE Vx, byte (4xkk)
+   Skip next instruction if Vx != kk. */
+static void _op_sne_byte(CHIP8 *chip8, const CHIP8I *in) {
+    if (chip8->V[in->x] != in->kk) {
+        chip8_skip_instr(chip8);
     }
+}
 
-    // Any key that was released previous frame gets turned off.
-    chip8_reset_released_keys(chip8);
+/* SE Vx, Vy (5xy0)
+   Skip next instruction if Vx = Vy. */
+static void _op_se_reg(CHIP8 *chip8, const CHIP8I *in) {
+    if (chip8->V[in->x] == chip8->V[in->y]) {
+        chip8_skip_instr(chip8);
+    }
 }
 
-void chip8_handle_timers(CHIP8 *chip8) {
-    // Delay
-    if (chip8->DT > 0) {
-        chip8->delay_cum += chip8->total_cycle_time;
+/* LD Vx, byte (6xkk)
+   Set Vx = kk. */
+static void _op_ld_byte(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->V[in->x] = in->kk;
+}
+
+/* ADD Vx, byte (7xkk)
+   Set Vx = Vx + kk. */
+static void _op_add_byte(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->V[in->x] += in->kk;
+}
 
-        if (!chip8->timer_freq || chip8->delay_cum >= chip8->timer_max_cum) {
-            chip8->DT--;
-            chip8->delay_cum = 0;
+/* LD Vx, Vy (8xy0)
+   Set Vx = Vy. */
+static void _op_ld_reg(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->V[in->x] = chip8->V[in->y];
+}
+
+/* OR Vx, Vy (8xy1)
+   Set Vx = Vx OR Vy. */
+static void _op_or(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->V[in->x] |= chip8->V[in->y];
+}
+
+/* AND Vx, Vy (8xy2)
+   Set Vx = Vx AND Vy. */
+static void _op_and(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->V[in->x] &= chip8->V[in->y];
+}
+
+/* XOR Vx, Vy (8xy3)
+   Set Vx = Vx XOR Vy. */
+static void _op_xor(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->V[in->x] ^= chip8->V[in->y];
+}
+
+/* ADD Vx, Vy (8xy4)
+   Set Vx = Vx + Vy, set VF = carry. */
+static void _op_add_reg(CHIP8 *chip8, const CHIP8I *in) {
+    bool carry = ((chip8->V[in->x] + chip8->V[in->y]) > 0xFF);
+    chip8->V[in->x] += chip8->V[in->y];
+    chip8->V[0x0F] = carry;
+}
+
+/* SUB Vx, Vy (8xy5)
+   Set Vx = Vx - Vy, set VF = NOT borrow. */
+static void _op_sub(CHIP8 *chip8, const CHIP8I *in) {
+    bool no_borrow = (chip8->V[in->x] >= chip8->V[in->y]);
+    chip8->V[in->x] = chip8->V[in->x] - chip8->V[in->y];
+    chip8->V[0x0F] = no_borrow;
+}
+
+/* SHR Vx {, Vy} (8xy6)
+   Legacy: Set Vx = Vy SHR 1.
+   S-CHIP: Set Vx = Vx SHR 1. */
+static ALWAYS_INLINE void _shr(CHIP8 *chip8, const CHIP8I *in, uint8_t quirks) {
+    if (!(quirks & QUIRK_SHIFT_VX)) {
+        chip8->V[in->x] = chip8->V[in->y];
+    }
+
+    chip8->V[0x0F] = chip8->V[in->x] & 0x01;
+    chip8->V[in->x] >>= 1;
+}
+
+/* SUBN Vx, Vy (8xy7)
+   Set Vx = Vy - Vx, set VF = NOT borrow. */
+static void _op_subn(CHIP8 *chip8, const CHIP8I *in) {
+    bool no_borrow = (chip8->V[in->y] >= chip8->V[in->x]);
+    chip8->V[in->x] = chip8->V[in->y] - chip8->V[in->x];
+    chip8->V[0x0F] = no_borrow;
+}
+
+/* SHL Vx {, Vy} (8xyE)
+   Legacy: Set Vx = Vy SHL 1.
+   S-CHIP: Set Vx = Vx SHL 1. */
+static ALWAYS_INLINE void _shl(CHIP8 *chip8, const CHIP8I *in, uint8_t quirks) {
+    if (!(quirks & QUIRK_SHIFT_VX)) {
+        chip8->V[in->x] = chip8->V[in->y];
+    }
+
+    chip8->V[0x0F] = (chip8->V[in->x] & 0x80) >> 7;
+    chip8->V[in->x] <<= 1;
+}
+
+/* SNE Vx, Vy (9xy0)
+   Skip next instruction if Vx != Vy. */
+static void _op_sne_reg(CHIP8 *chip8, const CHIP8I *in) {
+    if (chip8->V[in->x] != chip8->V[in->y]) {
+        chip8_skip_instr(chip8);
+    }
+}
+
+/* LD I, addr (Annn)
+   Set I = nnn. */
+static void _op_ld_i(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->I = CHIP8I_NNN(in);
+}
+
+/* JP V0, addr (Bnnn)
+   Legacy: Jump to location nnn + V0.
+   S-CHIP: Jump to location nnn + Vx. */
+static ALWAYS_INLINE void _jp_v0(CHIP8 *chip8, const CHIP8I *in, uint8_t quirks) {
+    uint16_t nnn = CHIP8I_NNN(in);
+    chip8->PC = (!(quirks & QUIRK_JP_VX)) ? chip8->V[0] + nnn : chip8->V[in->x] + nnn;
+}
+
+/* RND Vx, byte (Cxkk)
+   Set Vx = random byte AND kk. */
+static void _op_rnd(CHIP8 *chip8, const CHIP8I *in) {
+    uint8_t r = chip8->hooks.rand ? chip8->hooks.rand(chip8->hooks.ctx) : _xorshift(chip8);
+    chip8->V[in->x] = r & in->kk;
+}
+
+/* DRW Vx, Vy, n (Dxyn):
+   Legacy: Display n-byte sprite starting at memory location I at (Vx, Vy),
+   set VF = collision.
+   S-CHIP: If hires=false: If n=0, display 8x16 sprite. Else:
+   Same as Legacy. If hires=true: Same as Legacy, except
+   set VF = num rows collision. If n=0: Display 16x16 sprite starting at
+   memory location I at (Vx, Vy), set VF = num rows collision. */
+static ALWAYS_INLINE void _drw(CHIP8 *chip8, const CHIP8I *in, uint8_t quirks) {
+    _draw(chip8, chip8->V[in->x], chip8->V[in->y], CHIP8I_N(in), quirks);
+    chip8->stop = CHIP8_STOP_DISPLAY;
+}
+
+/* SKP Vx (Ex9E)
+   Skip next instruction if key with the value of Vx is pressed. */
+static void _op_skp(CHIP8 *chip8, const CHIP8I *in) {
+    if (chip8->keys_down & (1 << (chip8->V[in->x] & 0xF))) {
+        chip8_skip_instr(chip8);
+    }
+}
+
+/* SKNP Vx (ExA1)
+   Skip next instruction if key with the value of Vx is not pressed. */
+static void _op_sknp(CHIP8 *chip8, const CHIP8I *in) {
+    if (!(chip8->keys_down & (1 << (chip8->V[in->x] & 0xF)))) {
+        chip8_skip_instr(chip8);
+    }
+}
+
+/* LD Vx, DT (Fx07)
+   Set Vx = delay timer value. */
+static void _op_ld_vx_dt(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->V[in->x] = chip8->DT;
+}
+
+/* LD Vx, K (Fx0A)
+   Wait for a key press, store the value of the key in Vx. */
+static void _op_ld_vx_k(CHIP8 *chip8, const CHIP8I *in) {
+    chip8_wait_key(chip8, in->x);
+}
+
+/* LD DT, Vx (Fx15)
+   Set delay timer = Vx. */
+static void _op_ld_dt_vx(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->DT = chip8->V[in->x];
+    chip8->stop = CHIP8_STOP_TIMER;
+}
+
+/* LD ST, Vx (Fx18)
+   Set sound timer = Vx. */
+static void _op_ld_st_vx(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->ST = chip8->V[in->x];
+    chip8->stop = CHIP8_STOP_TIMER;
+
+    // The buzzer starts (or stops) now, not on the next tick.
+    if (chip8->timer_ticks) {
+        chip8->beep = chip8->ST > 0;
+    }
+}
+
+/* ADD I, Vx (Fx1E):
+   Set I = I + Vx. */
+static void _op_add_i(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->I += chip8->V[in->x];
+}
+
+/* LD F, Vx (Fx29)
+   Set I = location of 5-byte sprite for digit Vx. */
+static void _op_ld_f(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->I = FONT_START_ADDR + (chip8->V[in->x] * 0x05);
+}
+
+/* LD HF, Vx (Fx30) (S-CHIP Only)
+   Set I = location of 10-byte sprite for digit Vx. */
+static void _op_ld_hf(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->I = BIG_FONT_START_ADDR + (chip8->V[in->x] * 0x0A);
+}
+
+/* LD B, Vx (Fx33)
+   Store BCD representation of Vx in memory locations:
+   I, I+1, and I+2. */
+static void _op_ld_b(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->RAM[chip8->I] = (chip8->V[in->x] / 100) % 10;
+    chip8->RAM[chip8->I + 1] = (chip8->V[in->x] / 10) % 10;
+    chip8->RAM[chip8->I + 2] = chip8->V[in->x] % 10;
+    chip8_invalidate(chip8, chip8->I, 3);
+}
+
+/* LD [I], Vx (Fx55)
+   Store registers V0 through Vx in memory starting at location I.
+   Legacy: Set I=I+x+1 */
+static ALWAYS_INLINE void _ld_mem_vx(CHIP8 *chip8, const CHIP8I *in, uint8_t quirks) {
+    for (int r = 0; r <= in->x; r++) {
+        chip8->RAM[chip8->I + r] = chip8->V[r];
+    }
+
+    chip8_invalidate(chip8, chip8->I, in->x + 1);
+
+    if (!(quirks & QUIRK_KEEP_I)) {
+        chip8->I += (in->x + 1);
+    }
+}
+
+/* LD Vx, [I] (Fx65)
+   Read registers V0 through Vx from memory starting at location I.
+   Legacy: Set I=I+x+1 */
+static ALWAYS_INLINE void _ld_vx_mem(CHIP8 *chip8, const CHIP8I *in, uint8_t quirks) {
+    for (int r = 0; r <= in->x; r++) {
+        chip8->V[r] = chip8->RAM[chip8->I + r];
+    }
+
+    if (!(quirks & QUIRK_KEEP_I)) {
+        chip8->I += (in->x + 1);
+    }
+}
+
+/* LD R, Vx (Fx75) (S-CHIP Only)
+   Save user flags to disk. */
+static void _op_ld_r_vx(CHIP8 *chip8, const CHIP8I *in) {
+    chip8_handle_user_flags(chip8, in->x + 1, true);
+}
+
+/* LD Vx, R (Fx85) (S-CHIP Only)
+   Load user flags from disk. */
+static void _op_ld_vx_r(CHIP8 *chip8, const CHIP8I *in) {
+    chip8_handle_user_flags(chip8, in->x + 1, false);
+}
+
+// The handlers that depend on quirks, as Q(name, handler, ...).
+#define QUIRK_OPS(Q, ...)                 \
+    Q(LOW, low, __VA_ARGS__)              \
+    Q(HIGH, high, __VA_ARGS__)            \
+    Q(SHR, shr, __VA_ARGS__)              \
+    Q(SHL, shl, __VA_ARGS__)              \
+    Q(JP_V0, jp_v0, __VA_ARGS__)          \
+    Q(DRW, drw, __VA_ARGS__)              \
+    Q(LD_MEM_VX, ld_mem_vx, __VA_ARGS__)  \
+    Q(LD_VX_MEM, ld_vx_mem, __VA_ARGS__)
+
+#define GENERIC_HANDLER(name, handler, unused)                 \
+    static void _op_##handler(CHIP8 *chip8, const CHIP8I *in) { \
+        _##handler(chip8, in, chip8->quirks);                   \
+    }
+QUIRK_OPS(GENERIC_HANDLER, 0)
+#undef GENERIC_HANDLER
+
+// Handler table, indexed by CHIP8_OP.
+#define OP_HANDLER(name, handler, lo, hi, mnemonic) _op_##handler,
+static const CHIP8OP chip8_ops[NUM_CHIP8_OPS] = {
+    _op_trap,
+    _op_decode,
+    CHIP8_OPS(OP_HANDLER)
+};
+
+#if CHIP8_SPECIALIZE
+/* A handler table for each quirk set: the generic table, with the handlers
+that depend on quirks replaced by ones that have the set built in. */
+#define SET_HANDLER(name, handler, set, quirks)                        \
+    static void _op_##handler##_##set(CHIP8 *chip8, const CHIP8I *in) { \
+        _##handler(chip8, in, quirks);                                  \
+    }
+#define SET_ENTRY(name, handler, set, quirks) [CHIP8_OP_##name] = _op_##handler##_##set,
+#define SET_TABLE(set, quirks)                                  \
+    QUIRK_OPS(SET_HANDLER, set, quirks)                         \
+    static const CHIP8OP set##_ops[NUM_CHIP8_OPS] = {           \
+        _op_trap,                                               \
+        _op_decode,                                             \
+        CHIP8_OPS(OP_HANDLER)                                   \
+        QUIRK_OPS(SET_ENTRY, set, quirks)};
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"  // Replacing entries is the point
+CHIP8_QUIRK_SETS(SET_TABLE)
+#pragma GCC diagnostic pop
+#undef SET_TABLE
+#undef SET_ENTRY
+#undef SET_HANDLER
+#endif
+#undef OP_HANDLER
+
+// Picks the handler table for a ROM's quirks.
+static const CHIP8OP *_bind_ops(uint8_t quirks) {
+#if CHIP8_SPECIALIZE
+#define SET_MATCH(set, set_quirks) \
+    if (quirks == (set_quirks)) {  \
+        return set##_ops;          \
+    }
+    CHIP8_QUIRK_SETS(SET_MATCH)
+#undef SET_MATCH
+#else
+    (void)quirks;
+#endif
+
+    return chip8_ops;
+}
+
+/* Second-level decode tables, one per family, indexed by the family key.
+Keys that aren't listed are left 0, which is CHIP8_OP_TRAP. */
+#define OP_DECODE(name, handler, lo, hi, mnemonic) [lo ... hi] = CHIP8_OP_##name,
+#define FAMILY_TABLE(nibble, family, mask) \
+    static const uint8_t family##_ops[(mask) + 1] = {CHIP8_##family##_OPS(OP_DECODE)};
+CHIP8_FAMILIES(FAMILY_TABLE)
+#undef FAMILY_TABLE
+#undef OP_DECODE
+
+// Instructions that own their whole top nibble get a single-entry table.
+#define MAIN_TABLE(name, handler, lo, hi, mnemonic) \
+    static const uint8_t handler##_ops[1] = {CHIP8_OP_##name};
+CHIP8_MAIN_OPS(MAIN_TABLE)
+#undef MAIN_TABLE
+
+// First-level decode table, indexed by the top nibble of an instruction.
+static const struct {
+    const uint8_t *ops;
+    uint8_t mask;
+} main_ops[16] = {
+#define MAIN_ENTRY(name, handler, lo, hi, mnemonic) [lo] = {handler##_ops, 0x00},
+#define FAMILY_ENTRY(nibble, family, mask) [nibble] = {family##_ops, mask},
+    CHIP8_MAIN_OPS(MAIN_ENTRY)
+    CHIP8_FAMILIES(FAMILY_ENTRY)
+#undef FAMILY_ENTRY
+#undef MAIN_ENTRY
+};
+
+void chip8_decode(uint8_t b1, uint8_t b2, CHIP8I *in) {
+    uint8_t c = b1 >> 4;
+
+    in->op = main_ops[c].ops[b2 & main_ops[c].mask];
+    in->x = b1 & 0xF;
+    in->y = b2 >> 4;
+    in->kk = b2;
+}
+
+#if CHIP8_PROFILE
+#define CHIP8_OP_MNEMONIC(name, handler, lo, hi, mnemonic) [CHIP8_OP_##name] = mnemonic,
+static const char *const chip8_op_mnemonics[NUM_CHIP8_OPS] = {
+    [CHIP8_OP_TRAP] = "(unknown)",
+    [CHIP8_OP_DECODE] = "(decode + run)",
+    CHIP8_OPS(CHIP8_OP_MNEMONIC)};
+#undef CHIP8_OP_MNEMONIC
+
+// Runs an instruction's handler and adds what it cost to the profile.
+static inline void _dispatch(CHIP8 *chip8, const CHIP8I *in) {
+    // Decoding rewrites the cache entry, so hold on to the op it ran as
+    uint8_t op = in->op;
+    uint32_t start = cycles_get();
+
+    chip8->ops[op](chip8, in);
+
+    uint32_t cost = cycles_get() - start;
+    int bucket = 0;
+    while (bucket < CHIP8_PROFILE_BUCKETS - 1 && cost >= (16u << (2 * bucket))) {
+        bucket++;
+    }
+
+    chip8->op_count[op]++;
+    chip8->op_cost[op] += cost;
+    chip8->op_hist[op][bucket]++;
+}
+
+void chip8_profile_dump(CHIP8 *chip8, void (*write_str)(const char *str)) {
+    char line[160];
+
+    write_str("instruction        count        cost   avg |  <16  <64 <256  <1K  <4K <16K <64K more\r\n");
+
+    for (int op = 0; op < NUM_CHIP8_OPS; op++) {
+        if (!chip8->op_count[op]) {
+            continue;
+        }
+
+        int len = snprintf(line, sizeof(line), "%-14s %9lu %11llu %5lu |",
+                           chip8_op_mnemonics[op], (unsigned long)chip8->op_count[op],
+                           (unsigned long long)chip8->op_cost[op],
+                           (unsigned long)(chip8->op_cost[op] / chip8->op_count[op]));
+
+        for (int b = 0; b < CHIP8_PROFILE_BUCKETS && len < (int)sizeof(line); b++) {
+            len += snprintf(line + len, sizeof(line) - len, " %4lu",
+                            (unsigned long)chip8->op_hist[op][b]);
         }
+
+        write_str(line);
+        write_str("\r\n");
+    }
+}
+
+void chip8_profile_reset(CHIP8 *chip8) {
+    memset(chip8->op_count, 0, sizeof(chip8->op_count));
+    memset(chip8->op_cost, 0, sizeof(chip8->op_cost));
+    memset(chip8->op_hist, 0, sizeof(chip8->op_hist));
+}
+#else
+// Runs an instruction's handler.
+static inline void _dispatch(CHIP8 *chip8, const CHIP8I *in) {
+    chip8->ops[in->op](chip8, in);
+}
+#endif
+
+// Fetches, decodes, and executes the next instruction without any bookkeeping.
+static inline void _step(CHIP8 *chip8) {
+    chip8->num_instrs++;
+
+#if CHIP8_DECODE_CACHE
+    /* Instructions at even addresses are fetched from the decode cache.
+    Odd addresses (rare) are decoded every time instead. */
+    if (!(chip8->PC & 1)) {
+        const CHIP8I *in = &chip8->decoded[(chip8->PC & (MAX_RAM - 1)) >> 1];
+
+        chip8->PC += 2;
+        _dispatch(chip8, in);
+        return;
     }
+#endif
 
-    // Sound
-    if (chip8->ST > 0) {
-        chip8->beep = true;
-        chip8->sound_cum += chip8->total_cycle_time;
+    /* Fetch and decode */
+    CHIP8I in;
+    chip8_decode(chip8->RAM[chip8->PC], chip8->RAM[chip8->PC + 1], &in);
 
-        if (!chip8->timer_freq || chip8->sound_cum >= chip8->timer_max_cum) {
-            chip8->ST--;
-            chip8->sound_cum = 0;
+    /* Immediately set PC to next instruction
+    after fetching and decoding the current one. */
+    chip8->PC += 2;
+
+    /* Execute */
+    _dispatch(chip8, &in);
+}
+
+void chip8_execute(CHIP8 *chip8) {
+    _step(chip8);
+}
+
+CHIP8_STOP chip8_run(CHIP8 *chip8, uint32_t budget) {
+    chip8->stop = CHIP8_STOP_NONE;
+
+    while (budget > 0 && chip8->stop == CHIP8_STOP_NONE) {
+        _step(chip8);
+        budget--;
+    }
+
+    return chip8->stop;
+}
+
+void chip8_invalidate(CHIP8 *chip8, uint16_t addr, int len) {
+#if CHIP8_DECODE_CACHE
+    // An entry covers two bytes, so a write may touch one entry more than len / 2.
+    for (int i = addr >> 1; i <= (addr + len - 1) >> 1; i++) {
+        chip8->decoded[i & ((MAX_RAM / 2) - 1)].op = CHIP8_OP_DECODE;
+    }
+#else
+    (void)chip8;
+    (void)addr;
+    (void)len;
+#endif
+}
+
+/* Decrements a timer register unless it is 0. Compare-and-swap so a value
+stored by the interpreter in the meantime isn't overwritten. */
+static bool _count_down(volatile uint8_t *timer) {
+    uint8_t value = *timer;
+
+    while (value > 0) {
+        if (__atomic_compare_exchange_n(timer, &value, value - 1, false, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+            return true;
         }
-    } else {
-        chip8->beep = false;
+    }
+
+    return false;
+}
+
+void chip8_tick_timers(CHIP8 *chip8) {
+    _count_down(&chip8->DT);
+
+    /* A delay timer poll has something new to read. Woken on every tick, as the
+    interpreter may have gone idle just after the tick that stopped the timer. */
+    if (chip8->idle == CHIP8_IDLE_TIMER) {
+        chip8->idle = CHIP8_IDLE_NONE;
+    }
+
+    // The buzzer sounds until the tick that takes ST to 0.
+    _count_down(&chip8->ST);
+    chip8->beep = chip8->ST > 0;
+}
+
+/* Counts a timer down by the ticks elapsed this cycle. The remainder of a tick
+is carried over in cum, so the timer neither drifts nor depends on the cycle
+time. Returns whether it ticked. */
+static bool _handle_timer(CHIP8 *chip8, volatile uint8_t *timer, uint32_t *cum) {
+    bool ticked = false;
+
+    if (!chip8->timer_freq) {
+        return *timer > 0 && _count_down(timer);
+    }
+
+    *cum += chip8->total_cycle_time * chip8->timer_freq;
+    while (*cum >= ONE_SEC && *timer > 0) {
+        *cum -= ONE_SEC;
+        ticked = _count_down(timer);
+    }
+
+    // A stopped timer starts a fresh tick when it is set again.
+    if (!*timer) {
+        *cum = 0;
+    }
+
+    return ticked;
+}
+
+void chip8_handle_timers(CHIP8 *chip8) {
+    if (!chip8->timer_ticks) {
+        // Delay
+        if (_handle_timer(chip8, &chip8->DT, &chip8->delay_cum) && chip8->idle == CHIP8_IDLE_TIMER) {
+            // A delay timer poll has something new to read.
+            chip8->idle = CHIP8_IDLE_NONE;
+        }
+
+        // Sound
+        chip8->beep = chip8->ST > 0;
+        _handle_timer(chip8, &chip8->ST, &chip8->sound_cum);
     }
 
     // Screen Refresh
@@ -635,31 +1016,104 @@ void chip8_handle_timers(CHIP8 *chip8) {
     }
 }
 
+// Whole ms until cum, growing by rate each ms, reaches ONE_SEC.
+static uint32_t _ms_until_due(uint32_t cum, uint32_t rate) {
+    return cum >= ONE_SEC ? 0 : (ONE_SEC - cum + rate - 1) / rate;
+}
+
+static uint32_t _min(uint32_t a, uint32_t b) {
+    return a < b ? a : b;
+}
+
+uint32_t chip8_next_cycle_ms(CHIP8 *chip8) {
+    uint32_t ms = UINT32_MAX;
+
+    // Owed instructions
+    if (!chip8->idle) {
+        if (!chip8->cpu_freq) {
+            return 0;
+        }
+        ms = _ms_until_due(chip8->cpu_debt, chip8->cpu_freq);
+    }
+
+    // Timer ticks, unless they come from outside
+    if (!chip8->timer_ticks && (chip8->DT || chip8->ST)) {
+        if (!chip8->timer_freq) {
+            return 0;
+        }
+        if (chip8->DT) {
+            ms = _min(ms, _ms_until_due(chip8->delay_cum, chip8->timer_freq));
+        }
+        if (chip8->ST) {
+            ms = _min(ms, _ms_until_due(chip8->sound_cum, chip8->timer_freq));
+        }
+    }
+
+    // Display refresh
+    if (!chip8->refresh_freq) {
+        return 1;
+    }
+    if (chip8->refresh_cum < chip8->refresh_max_cum) {
+        ms = _min(ms, chip8->refresh_max_cum - chip8->refresh_cum);
+    }
+
+    // Nothing can happen until the clock moves on
+    return ms ? ms : 1;
+}
+
 void chip8_update_elapsed_time(CHIP8 *chip8) {
     chip8->prev_cycle_start = chip8->cur_cycle_start;
-    chip8->cur_cycle_start = clock_get();
+    chip8->cur_cycle_start = chip8->hooks.clock(chip8->hooks.ctx);
     chip8->total_cycle_time = chip8->cur_cycle_start - chip8->prev_cycle_start;
 }
 
-void chip8_reset_keypad(CHIP8 *chip8) {
-    for (int k = 0; k < NUM_KEYS; k++) {
-        chip8->keypad[k] = KEY_UP;
+void chip8_press_keys(CHIP8 *chip8, uint16_t keys) {
+    if (keys & ~chip8->keys_down) {
+        chip8->keys_down |= keys;
+        chip8->keys_released &= ~keys;
+
+        if (chip8->idle == CHIP8_IDLE_KEY) {
+            chip8->idle = CHIP8_IDLE_NONE;
+        }
     }
 }
 
-void chip8_reset_released_keys(CHIP8 *chip8) {
-    for (int k = 0; k < NUM_KEYS; k++) {
-        if (chip8->keypad[k] == KEY_RELEASED) {
-            chip8->keypad[k] = KEY_UP;
+void chip8_release_keys(CHIP8 *chip8, uint16_t keys) {
+    if (keys) {
+        chip8->keys_down &= ~keys;
+        chip8->keys_released |= keys;
+
+        if (chip8->idle == CHIP8_IDLE_KEY) {
+            chip8->idle = CHIP8_IDLE_NONE;
         }
     }
 }
 
+uint8_t chip8_idle_percent(CHIP8 *chip8) {
+    uint64_t total = (uint64_t)chip8->num_instrs + chip8->num_idle_instrs;
+
+    if (!total) {
+        return 0;
+    }
+
+    return (chip8->num_idle_instrs * 100ULL) / total;
+}
+
+void chip8_reset_keypad(CHIP8 *chip8) {
+    chip8->keys_down = 0;
+    chip8->keys_released = 0;
+}
+
 void chip8_reset_display(CHIP8 *chip8) {
-    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-        for (int x = 0; x < DISPLAY_WIDTH_BYTES; x++) {
-            chip8->display[y][x] = 0;
-        }
+    memset(chip8->display, 0, sizeof(chip8->display));
+    memset(chip8->lores, 0, sizeof(chip8->lores));
+
+    chip8_mark_display_dirty(chip8);
+}
+
+void chip8_mark_display_dirty(CHIP8 *chip8) {
+    for (int p = 0; p < DISPLAY_PAGES; p++) {
+        chip8->display_dirty[p] = 0xFFFF;
     }
 }
 
@@ -678,147 +1132,464 @@ void chip8_reset_registers(CHIP8 *chip8) {
 void chip8_load_instr(CHIP8 *chip8, uint16_t instr) {
     chip8->RAM[chip8->pc_start_addr] = instr >> 8;
     chip8->RAM[chip8->pc_start_addr + 1] = instr & 0x00FF;
+    chip8_invalidate(chip8, chip8->pc_start_addr, 2);
 }
 
-void chip8_draw(CHIP8 *chip8, uint8_t x, uint8_t y, uint8_t n) {
-    // This function is ugly and could probably use some refactoring...
+/* Doubles every bit of a nibble (0b0101 -> 0b00110011). Used to scale the
+lo-res plane up to the hi-res display a whole byte at a time. */
+static const uint8_t nibble_expand[16] = {
+    0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F,
+    0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF};
+
+/* Halves a byte into a nibble, each bit of which is set if either bit of its
+pair was (0b00110010 -> 0b0101). The reverse of nibble_expand, give or take. */
+static uint8_t _squeeze(uint8_t bits) {
+    bits = (bits | (bits >> 1)) & 0x55;
+    bits = (bits | (bits >> 1)) & 0x33;
+    return (bits | (bits >> 2)) & 0x0F;
+}
+
+#if CHIP8_PAGE_MAJOR
+/* Turns an 8x8 block of sprite pixels stored as rows (bit 7 leftmost) into
+columns (bit 0 topmost), the way the page-major display stores them. */
+static void _transpose8(const uint8_t rows[8], uint8_t cols[8]) {
+    // Packing the rows bottom first puts row 0 in bit 0 of each column.
+    uint32_t hi = ((uint32_t)rows[7] << 24) | (rows[6] << 16) | (rows[5] << 8) | rows[4];
+    uint32_t lo = ((uint32_t)rows[3] << 24) | (rows[2] << 16) | (rows[1] << 8) | rows[0];
+    uint32_t t;
+
+    // Swap 1x1, then 2x2, then 4x4 blocks across the diagonal.
+    t = (hi ^ (hi >> 7)) & 0x00AA00AA;
+    hi = hi ^ t ^ (t << 7);
+    t = (lo ^ (lo >> 7)) & 0x00AA00AA;
+    lo = lo ^ t ^ (t << 7);
+
+    t = (hi ^ (hi >> 14)) & 0x0000CCCC;
+    hi = hi ^ t ^ (t << 14);
+    t = (lo ^ (lo >> 14)) & 0x0000CCCC;
+    lo = lo ^ t ^ (t << 14);
+
+    t = (hi & 0xF0F0F0F0) | ((lo >> 4) & 0x0F0F0F0F);
+    lo = ((hi << 4) & 0xF0F0F0F0) | (lo & 0x0F0F0F0F);
+    hi = t;
+
+    for (int i = 0; i < 4; i++) {
+        cols[i] = hi >> (24 - (i * 8));
+        cols[i + 4] = lo >> (24 - (i * 8));
+    }
+}
+
+/* XORs a strip of pixels (bit 0 topmost) onto column x of the plane being drawn
+on (width columns by pages), starting at pixel row y and clipping anything past
+the edges. Returns the bits of the strip that erased a pixel. */
+static uint32_t _blit_column(CHIP8 *chip8, uint8_t *plane, unsigned width, unsigned pages,
+                             unsigned x, unsigned y, uint32_t strip) {
+    if (x >= width) {
+        return 0;
+    }
+
+    unsigned page = y / 8;
+    unsigned shift = y % 8;
+    uint32_t window = strip << shift;
+    uint32_t collide = 0;
+
+    // A strip of up to 16 pixels straddles up to 3 pages.
+    for (int i = 0; window && page < pages; i++, page++, window >>= 8) {
+        uint8_t bits = window & 0xFF;
+        uint8_t *col = &plane[(page * width) + x];
+
+        collide |= (uint32_t)(*col & bits) << (i * 8);
+        *col ^= bits;
+
+        // A lo-res page covers two pages of the display.
+        if (chip8->hires) {
+            chip8->display_dirty[page] |= 1 << (x / 8);
+        } else {
+            chip8->display_dirty[page * 2] |= 1 << (x / 4);
+            chip8->display_dirty[(page * 2) + 1] |= 1 << (x / 4);
+        }
+    }
+
+    return collide >> shift;
+}
+
+// Draws a sprite column by column onto the page-major display or lo-res plane.
+static void _draw_sprite(CHIP8 *chip8, const uint8_t *sprite, unsigned x, unsigned y,
+                         int rows, int row_bytes, bool count_rows) {
+    uint8_t *plane = chip8->hires ? chip8->display[0] : chip8->lores[0];
+    unsigned width = chip8->hires ? DISPLAY_WIDTH : LORES_WIDTH;
+    unsigned pages = chip8->hires ? DISPLAY_PAGES : LORES_PAGES;
+    bool collide = false;
+    uint32_t collide_rows = 0;
+
+    for (int block = 0; block < rows; block += 8) {
+        unsigned py = y + block;
+        if (py >= pages * 8) {
+            break;
+        }
+
+        for (int b = 0; b < row_bytes; b++) {
+            uint8_t block_rows[8] = {0};
+            uint8_t cols[8];
+
+            for (int r = 0; r < 8 && block + r < rows; r++) {
+                block_rows[r] = sprite[(block + r) * row_bytes + b];
+            }
+
+            _transpose8(block_rows, cols);
+
+            for (int c = 0; c < 8; c++) {
+                if (!cols[c]) {
+                    continue;
+                }
+
+                uint32_t hit = _blit_column(chip8, plane, width, pages, x + (b * 8) + c, py, cols[c]);
+
+                if (hit) {
+                    collide = true;
+                    collide_rows |= hit << block;
+                }
+            }
+        }
+    }
+
+    /* If a pixel is erased, set VF to 1, or in hires with collision
+    enumeration count the number of rows that collided. */
+    if (collide) {
+        if (count_rows) {
+            while (collide_rows) {
+                collide_rows &= collide_rows - 1;
+                chip8->V[0x0F]++;
+            }
+        } else {
+            chip8->V[0x0F] = 1;
+        }
+    }
+}
+#else
+/* XORs num_bytes of sprite data onto a row of width_bytes starting at pixel x,
+clipping anything past the right edge. Returns non-zero if any pixel was erased. */
+static uint8_t _blit_row(uint8_t *row, unsigned width_bytes, unsigned x,
+                         const uint8_t *sprite, int num_bytes) {
+    unsigned byte = x / 8;
+    unsigned shift = x % 8;
+    uint8_t collide = 0;
+
+    for (int i = 0; i < num_bytes && byte < width_bytes; i++, byte++) {
+        // Each sprite byte straddles two display bytes unless x is aligned.
+        uint16_t window = sprite[i] << (8 - shift);
+        uint8_t left = window >> 8;
+        uint8_t right = window & 0xFF;
+
+        collide |= row[byte] & left;
+        row[byte] ^= left;
+
+        if (right && byte + 1 < width_bytes) {
+            collide |= row[byte + 1] & right;
+            row[byte + 1] ^= right;
+        }
+    }
+
+    return collide;
+}
+
+// Draws a sprite row by row onto the row-major display or lo-res plane.
+static void _draw_sprite(CHIP8 *chip8, const uint8_t *sprite, unsigned x, unsigned y,
+                         int rows, int row_bytes, bool count_rows) {
+    uint8_t *plane = chip8->hires ? chip8->display[0] : chip8->lores[0];
+    unsigned width_bytes = chip8->hires ? DISPLAY_WIDTH_BYTES : LORES_WIDTH_BYTES;
+    unsigned height = chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    int scale = chip8->hires ? 1 : 2;
+
+    // The display bytes each row of the sprite touches once scaled up.
+    uint16_t dirty = 0;
+    unsigned first_byte = (x * scale) / 8;
+    if (first_byte < DISPLAY_WIDTH_BYTES) {
+        unsigned last_byte = (((x + (row_bytes * 8)) * scale) - 1) / 8;
+        if (last_byte >= DISPLAY_WIDTH_BYTES) {
+            last_byte = DISPLAY_WIDTH_BYTES - 1;
+        }
 
+        dirty = ((1u << (last_byte + 1)) - 1) & ~((1u << first_byte) - 1);
+    }
+
+    for (int i = 0; i < rows; i++, sprite += row_bytes) {
+        unsigned py = y + i;
+        if (py >= height) {
+            break;
+        }
+
+        uint8_t collide = _blit_row(&plane[py * width_bytes], width_bytes, x, sprite, row_bytes);
+        chip8->display_dirty[(py * scale) / 8] |= dirty;
+
+        /* If a pixel is erased, set VF to 1, or in hires with collision
+        enumeration count the number of rows that collided. */
+        if (collide) {
+            if (count_rows) {
+                chip8->V[0x0F]++;
+            } else {
+                chip8->V[0x0F] = 1;
+            }
+        }
+    }
+}
+#endif
+
+static ALWAYS_INLINE void _draw(CHIP8 *chip8, uint8_t x, uint8_t y, uint8_t n, uint8_t quirks) {
     chip8->V[0x0F] = 0;
-    int rows;
 
     /* n==0 only has signifigance in S-CHIP mode,
     otherwise nothing should be drawn. */
     if (n == 0) {
         /* Draw a 32-byte (16x16) sprite in hires or
         a 16-byte (8x16) sprite in lores. */
-        n = (chip8->hires || !chip8->quirks[3]) ? 32 : 16;
+        n = (chip8->hires || !(quirks & QUIRK_LORES_8X16)) ? 32 : 16;
     }
 
-    if (chip8->hires && chip8->quirks[7]) {
-        rows = (n == 32) ? 16 : n;
+    // Big sprites are two bytes wide, so 16 rows.
+    int row_bytes = (n == 32) ? 2 : 1;
+    int rows = n / row_bytes;
+
+    if (chip8->hires && (quirks & QUIRK_BOTTOM)) {
         chip8->V[0x0F] += ((y + rows) - (DISPLAY_HEIGHT - 1));
-    } else {
-        rows = n;
     }
 
     // Allow out-of-bound sprite to wrap-around.
-    if (!chip8->quirks[5]) {
+    if (!(quirks & QUIRK_CLIP)) {
         y %= DISPLAY_HEIGHT;
         x %= DISPLAY_WIDTH;
     }
 
-    bool prev_byte_collide = false;
-
-    for (int i = 0; i < n; i++) {
-        bool collide_row = false;
-
-        for (int j = 0; j < 8; j++) {
-            /* For big sprites, every odd byte needs to be drawn on the same
-            row as the previous byte. This is achieved through integer division
-            truncation. The odd byte also needs to be drawn 8 pixels to the
-            right of the previous byte. */
-            unsigned y_start = (n == 32) ? (i / 2) : i;
-            unsigned x_start = (n == 32 && (i % 2 != 0)) ? (j + 8) : j;
-
-            /* Now we have to scale the display if we are in lo-res mode
-            by basically drawing each pixel twice. */
-            int scale = chip8->hires ? 1 : 2;
-            for (int h = 0; h < scale; h++) {
-                for (int k = 0; k < scale; k++) {
-                    int disp_x = (x * scale) + (x_start * scale) + k;
-                    int disp_y = (y * scale) + (y_start * scale) + h;
-                    if (disp_x >= DISPLAY_WIDTH || disp_y >= DISPLAY_HEIGHT) {
-                        break;
-                    }
-
-                    bool pixel_on = false;
-                    bool bit = false;
-                    bool collide = false;
-
-                    /* Get the pixel the loop is on and the corresponding bit
-                    and XOR them onto display. If a pixel is erased, set the VF
-                    register to 1. */
-                    pixel_on = chip8_get_pixel(chip8->display, disp_x, disp_y);
-                    bit = (chip8->RAM[chip8->I + i] >> (7 - j)) & 0x01;
-                    collide = pixel_on && bit;
-                    chip8_set_pixel(chip8->display, disp_x, disp_y, pixel_on ^ bit);
-
-                    if (collide) {
-                        if (chip8->hires && chip8->quirks[6]) {
-                            if (!collide_row) {
-                                if (n <= 16 || (((i % 2 == 0) && n == 32) ||
-                                                !prev_byte_collide)) {
-                                    chip8->V[0x0F]++;
-                                    collide_row = true;
-                                }
-                            }
-                        } else {
-                            chip8->V[0x0F] = 1;
-                        }
-                    }
-                }
-            }
+    _draw_sprite(chip8, &chip8->RAM[chip8->I], x, y, rows, row_bytes,
+                 chip8->hires && (quirks & QUIRK_COUNT_ROWS));
+}
+
+void chip8_draw(CHIP8 *chip8, uint8_t x, uint8_t y, uint8_t n) {
+    _draw(chip8, x, y, n, chip8->quirks);
+}
+
+#if CHIP8_PAGE_MAJOR
+// Shifts column x of a plane (width columns by pages) down (dir=1) or up (dir=-1).
+static void _shift_column(uint8_t *plane, int width, int pages, int x, int dir, int num_pixels) {
+    int shift = num_pixels / 8;
+    int bits = num_pixels % 8;
+
+    // Row 0 is bit 0 of page 0, so moving down shifts towards higher bits.
+    if (dir == 1) {
+        for (int p = pages - 1; p >= 0; p--) {
+            int src = p - shift;
+            uint8_t lo = (src >= 0) ? plane[(src * width) + x] : 0;
+            uint8_t hi = (src >= 1) ? plane[((src - 1) * width) + x] : 0;
+
+            plane[(p * width) + x] = bits ? (lo << bits) | (hi >> (8 - bits)) : lo;
         }
+    } else {
+        for (int p = 0; p < pages; p++) {
+            int src = p + shift;
+            uint8_t hi = (src < pages) ? plane[(src * width) + x] : 0;
+            uint8_t lo = (src + 1 < pages) ? plane[((src + 1) * width) + x] : 0;
 
-        prev_byte_collide = collide_row;
+            plane[(p * width) + x] = bits ? (hi >> bits) | (lo << (8 - bits)) : hi;
+        }
     }
 }
 
 void chip8_scroll(CHIP8 *chip8, int xdir, int ydir, int num_pixels) {
-    int x_start = 0;
-    int x_end = DISPLAY_WIDTH;
-    int y_start = 0;
-    int y_end = DISPLAY_HEIGHT;
+    uint8_t *plane = chip8->hires ? chip8->display[0] : chip8->lores[0];
+    int width = chip8->hires ? DISPLAY_WIDTH : LORES_WIDTH;
+    int pages = chip8->hires ? DISPLAY_PAGES : LORES_PAGES;
 
-    if (xdir == 1) {
-        x_end = DISPLAY_WIDTH - num_pixels;
-    } else if (xdir == -1) {
-        x_start = num_pixels;
+    // Scrolling is in hi-res pixels, which lo-res can only round up to whole pixels.
+    if (!chip8->hires) {
+        num_pixels = (num_pixels + 1) / 2;
     }
-    if (ydir == 1) {
-        y_end = DISPLAY_HEIGHT - num_pixels;
-    } else if (ydir == -1) {
-        y_start = num_pixels;
+
+    chip8_mark_display_dirty(chip8);
+
+    if (ydir) {
+        int rows = (num_pixels < pages * 8) ? num_pixels : pages * 8;
+
+        for (int x = 0; x < width; x++) {
+            _shift_column(plane, width, pages, x, ydir, rows);
+        }
     }
 
-    // Create updated display buffers.
-    uint8_t disp_buf[DISPLAY_HEIGHT][DISPLAY_WIDTH_BYTES];
-    for (int i = 0; i < DISPLAY_HEIGHT; i++) {
-        for (int j = 0; j < DISPLAY_WIDTH_BYTES; j++) {
-            disp_buf[i][j] = 0;
+    if (xdir) {
+        int cols = (num_pixels < width) ? num_pixels : width;
+        int keep = width - cols;
+
+        // Move the columns of each page that stay on screen, then clear the rest.
+        for (int p = 0; p < pages; p++, plane += width) {
+            if (xdir == 1) {
+                memmove(&plane[cols], &plane[0], keep);
+                memset(&plane[0], 0, cols);
+            } else {
+                memmove(&plane[0], &plane[cols], keep);
+                memset(&plane[keep], 0, cols);
+            }
         }
     }
+}
 
-    for (int y = y_start; y < y_end; y++) {
-        for (int x = x_start; x < x_end; x++) {
-            int buf_y = y + (ydir * num_pixels);
-            int buf_x = x + (xdir * num_pixels);
+void chip8_present(CHIP8 *chip8) {
+    if (chip8->hires) {
+        return;
+    }
+
+    // Rebuild every changed display byte from the nibble of the lo-res plane it doubles.
+    for (int p = 0; p < DISPLAY_PAGES; p++) {
+        uint16_t bands = chip8->display_dirty[p];
+        int shift = (p % 2) * 4;
 
-            chip8_set_pixel(disp_buf, buf_x, buf_y, chip8_get_pixel(chip8->display, x, y));
+        for (int x = 0; bands; bands >>= 1, x += 8) {
+            if (!(bands & 1)) {
+                continue;
+            }
+
+            for (int c = x; c < x + 8; c++) {
+                chip8->display[p][c] = nibble_expand[(chip8->lores[p / 2][c / 2] >> shift) & 0x0F];
+            }
         }
     }
+}
 
-    // Copy updated display buffer into actual display.
-    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
-        for (int x = 0; x < DISPLAY_WIDTH_BYTES; x++) {
-            chip8->display[y][x] = disp_buf[y][x];
+// Shrinks the display into the lo-res plane, a lo-res pixel being on if any of its 2x2 block is.
+static void _shrink_display(CHIP8 *chip8) {
+    for (int p = 0; p < LORES_PAGES; p++) {
+        for (int x = 0; x < LORES_WIDTH; x++) {
+            uint8_t top = chip8->display[p * 2][x * 2] | chip8->display[p * 2][(x * 2) + 1];
+            uint8_t bottom = chip8->display[(p * 2) + 1][x * 2] | chip8->display[(p * 2) + 1][(x * 2) + 1];
+
+            chip8->lores[p][x] = _squeeze(top) | (_squeeze(bottom) << 4);
         }
     }
 }
+#else
+// Shifts a row of width_bytes right (dir=1) or left (dir=-1) by num_pixels.
+static void _shift_row(uint8_t *row, int width_bytes, int dir, int num_pixels) {
+    int bytes = num_pixels / 8;
+    int bits = num_pixels % 8;
+
+    /* Each byte takes its new pixels from the byte num_pixels before (or after)
+    it, with the bits that don't fit carried in from the byte next to that. */
+    if (dir == 1) {
+        for (int i = width_bytes - 1; i >= 0; i--) {
+            int src = i - bytes;
+            uint8_t hi = (src >= 0) ? row[src] : 0;
+            uint8_t lo = (src >= 1) ? row[src - 1] : 0;
+
+            row[i] = bits ? (hi >> bits) | (lo << (8 - bits)) : hi;
+        }
+    } else {
+        for (int i = 0; i < width_bytes; i++) {
+            int src = i + bytes;
+            uint8_t lo = (src < width_bytes) ? row[src] : 0;
+            uint8_t hi = (src + 1 < width_bytes) ? row[src + 1] : 0;
 
-void chip8_wait_key(CHIP8 *chip8, uint8_t x) {
-    bool key_released = false;
+            row[i] = bits ? (lo << bits) | (hi >> (8 - bits)) : lo;
+        }
+    }
+}
 
-    for (int i = 0; i < NUM_KEYS; i++) {
-        if (chip8->keypad[i] == KEY_RELEASED) {
-            chip8->V[x] = i;
-            key_released = true;
-            break;
+void chip8_scroll(CHIP8 *chip8, int xdir, int ydir, int num_pixels) {
+    uint8_t *plane = chip8->hires ? chip8->display[0] : chip8->lores[0];
+    int width_bytes = chip8->hires ? DISPLAY_WIDTH_BYTES : LORES_WIDTH_BYTES;
+    int height = chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+
+    // Scrolling is in hi-res pixels, which lo-res can only round up to whole pixels.
+    if (!chip8->hires) {
+        num_pixels = (num_pixels + 1) / 2;
+    }
+
+    chip8_mark_display_dirty(chip8);
+
+    if (ydir) {
+        int rows = (num_pixels < height) ? num_pixels : height;
+        int keep = height - rows;
+
+        // Move the rows that stay on screen, then clear the ones scrolled in.
+        if (ydir == 1) {
+            memmove(&plane[rows * width_bytes], plane, keep * width_bytes);
+            memset(plane, 0, rows * width_bytes);
+        } else {
+            memmove(plane, &plane[rows * width_bytes], keep * width_bytes);
+            memset(&plane[keep * width_bytes], 0, rows * width_bytes);
+        }
+    }
+
+    if (xdir) {
+        for (int y = 0; y < height; y++, plane += width_bytes) {
+            if (num_pixels >= width_bytes * 8) {
+                memset(plane, 0, width_bytes);
+            } else {
+                _shift_row(plane, width_bytes, xdir, num_pixels);
+            }
         }
     }
+}
+
+void chip8_present(CHIP8 *chip8) {
+    if (chip8->hires) {
+        return;
+    }
+
+    // Rebuild every changed display byte from the nibble of the lo-res plane it doubles.
+    for (int p = 0; p < DISPLAY_PAGES; p++) {
+        uint16_t bands = chip8->display_dirty[p];
 
-    if (!key_released) {
+        for (int b = 0; bands; bands >>= 1, b++) {
+            if (!(bands & 1)) {
+                continue;
+            }
+
+            int shift = (b % 2) ? 0 : 4;
+            for (int y = p * 8; y < (p * 8) + 8; y++) {
+                chip8->display[y][b] = nibble_expand[(chip8->lores[y / 2][b / 2] >> shift) & 0x0F];
+            }
+        }
+    }
+}
+
+// Shrinks the display into the lo-res plane, a lo-res pixel being on if any of its 2x2 block is.
+static void _shrink_display(CHIP8 *chip8) {
+    for (int y = 0; y < LORES_HEIGHT; y++) {
+        for (int b = 0; b < LORES_WIDTH_BYTES; b++) {
+            uint8_t left = chip8->display[y * 2][b * 2] | chip8->display[(y * 2) + 1][b * 2];
+            uint8_t right = chip8->display[y * 2][(b * 2) + 1] | chip8->display[(y * 2) + 1][(b * 2) + 1];
+
+            chip8->lores[y][b] = (_squeeze(left) << 4) | _squeeze(right);
+        }
+    }
+}
+#endif
+
+void chip8_set_hires(CHIP8 *chip8, bool hires) {
+    if (hires == chip8->hires) {
+        return;
+    }
+
+    // The display always changes, even if only from the lo-res plane being scaled up.
+    chip8_mark_display_dirty(chip8);
+
+    if (hires) {
+        chip8_present(chip8);
+    } else {
+        _shrink_display(chip8);
+    }
+
+    chip8->hires = hires;
+}
+
+void chip8_wait_key(CHIP8 *chip8, uint8_t x) {
+    if (chip8->keys_released) {
+        chip8->V[x] = __builtin_ctz(chip8->keys_released);
+
+        // Only the first Fx0A of a frame may see the release.
+        chip8->keys_released = 0;
+    } else {
         chip8->PC -= 2;
+        chip8->stop = CHIP8_STOP_KEY_WAIT;
+        chip8->idle = CHIP8_IDLE_KEY;
     }
 }
 
@@ -826,7 +1597,8 @@ bool chip8_handle_user_flags(CHIP8 *chip8, int num_flags, bool save) {
     if (num_flags <= NUM_USER_FLAGS) {
         if (save) {
             memcpy(&chip8->metadata[USER_FLAGS_IDX], chip8->V, num_flags);
-            sd_write_block(chip8->rom_num * 8, chip8->metadata);
+            if (chip8->hooks.save)
+                chip8->hooks.save(chip8->hooks.ctx, chip8->rom_num, chip8->metadata);
         } else {
             /* Look for a 'signature' of DEADBEEF to check if flags have ever
              * actually been saved before reading them in. */
@@ -844,7 +1616,26 @@ void chip8_skip_instr(CHIP8 *chip8) {
     chip8->PC += 2;
 }
 
-void chip8_set_pixel(uint8_t buf[DISPLAY_HEIGHT][DISPLAY_WIDTH_BYTES], int x, int y, bool on) {
+#if CHIP8_PAGE_MAJOR
+void chip8_set_pixel(CHIP8_FB buf, int x, int y, bool on) {
+    int page = y / 8;
+    int bit = y % 8;
+
+    if (on) {
+        buf[page][x] |= (1 << bit);
+    } else {
+        buf[page][x] &= ~(1 << bit);
+    }
+}
+
+bool chip8_get_pixel(CHIP8_FB buf, int x, int y) {
+    int page = y / 8;
+    int bit = y % 8;
+
+    return ((buf[page][x]) & (1 << bit));
+}
+#else
+void chip8_set_pixel(CHIP8_FB buf, int x, int y, bool on) {
     int byte = (x / 8);
     int bit = x % 8;
 
@@ -855,9 +1646,10 @@ void chip8_set_pixel(uint8_t buf[DISPLAY_HEIGHT][DISPLAY_WIDTH_BYTES], int x, in
     }
 }
 
-bool chip8_get_pixel(uint8_t buf[DISPLAY_HEIGHT][DISPLAY_WIDTH_BYTES], int x, int y) {
+bool chip8_get_pixel(CHIP8_FB buf, int x, int y) {
     int byte = (x / 8);
     int bit = x % 8;
 
     return ((buf[y][byte]) & (1 << (7 - bit)));
 }
+#endif
@@ -1,5 +1,6 @@
 #include "clock.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "gpio.h"
@@ -13,34 +14,95 @@
 #define TIM2_CR1 (*((volatile uint32_t *)(TIM2 + 0x00)))
 #define TIM2_DIER (*((volatile uint32_t *)(TIM2 + 0x0C)))
 #define TIM2_SR (*((volatile uint32_t *)(TIM2 + 0x10)))
+#define TIM2_CCR1 (*((volatile uint32_t *)(TIM2 + 0x34)))
+#define TIM2_EGR (*((volatile uint32_t *)(TIM2 + 0x14)))
 #define TIM2_CNT (*((volatile uint32_t *)(TIM2 + 0x24)))
 #define TIM2_PSC (*((volatile uint32_t *)(TIM2 + 0x28)))
 #define TIM2_ARR (*((volatile uint32_t *)(TIM2 + 0x2C)))
 #define TIM2EN 1
+#define UIF 1
+#define CC1IF (1 << 1)
+#define UIE 1
+#define CC1IE (1 << 1)
+#define UG 1
+#define CC1G (1 << 1)
 
-static volatile uint32_t elapsed_ms = 0;
+#define TICKS_PER_SEC 1000000
+#define COUNTER_BITS 16
+#define COUNTER_MAX ((1 << COUNTER_BITS) - 1)
+
+// Times the 16-bit counter has wrapped, the high bits of the us count.
+static volatile uint32_t overflows = 0;
 
 void TIM2_IRQHandler(void) {
-    elapsed_ms += 1000;  // Since this ISR is called every second
-    TIM2_SR &= ~1;       // Clear interrupt
+    // Flags are cleared by writing 0 to them alone, so none set meanwhile are lost
+    if (TIM2_SR & UIF) {
+        TIM2_SR = ~UIF;
+        overflows++;
+    }
+
+    // The alarm only has to wake the CPU, so just disarm it
+    if (TIM2_SR & CC1IF) {
+        TIM2_SR = ~CC1IF;
+        TIM2_DIER &= ~CC1IE;
+    }
 }
 
 void clock_start(void) {
     RCC_APB1ENR |= TIM2EN;
-    NVIC_ISER0 |= TIM2_NVIC;
-    TIM2_DIER |= 1;
 
-    /* We want overflow to happen every second.
-     * So we scale the clock in a way that it becomes a 1KHz clock
-     * We then set the ARR to 1000, so an interrupt is
-     * generated every second.*/
-    TIM2_PSC = APB1_CLOCK_SPEED / 1000;
-    TIM2_ARR = 1000;
+    /* Count every us and let the counter run its full 16 bits, so the ISR
+     * only has to carry into the high bits every 65.536 ms.
+     * Timers on APB1 run at twice its speed whenever it is divided down. */
+    long timer_clock = APB1_CLOCK_SPEED == AHB_CLOCK_SPEED ? APB1_CLOCK_SPEED : APB1_CLOCK_SPEED * 2;
+    TIM2_PSC = (timer_clock / TICKS_PER_SEC) - 1;
+    TIM2_ARR = COUNTER_MAX;
+
+    // Load the prescaler now rather than at the first overflow
+    TIM2_EGR = UG;
+    TIM2_SR = ~UIF;
+    overflows = 0;
 
+    TIM2_DIER |= UIE;
+    NVIC_ISER0 |= TIM2_NVIC;
     TIM2_CR1 |= 1;  // Finally enable timer
 }
 
+uint64_t clock_us(void) {
+    uint32_t high;
+    uint32_t count;
+    bool pending;
+
+    // Read again if the ISR ran in between
+    do {
+        high = overflows;
+        count = TIM2_CNT;
+        pending = TIM2_SR & UIF;
+    } while (high != overflows);
+
+    /* When called with the ISR held off (from another interrupt) the counter
+     * may have wrapped without the high bits being carried. A small count
+     * means it wrapped before it was read. */
+    if (pending && count < (COUNTER_MAX / 2))
+        high++;
+
+    return ((uint64_t)high << COUNTER_BITS) | count;
+}
+
 uint32_t clock_get(void) {
-    // Return ms count plus whats still in the counter
-    return elapsed_ms + TIM2_CNT;
+    return clock_us() / 1000;
+}
+
+void clock_alarm(uint64_t us) {
+    // Further off than the counter reaches, the overflow interrupt will do
+    if (us - clock_us() > COUNTER_MAX)
+        return;
+
+    TIM2_CCR1 = us & COUNTER_MAX;
+    TIM2_SR = ~CC1IF;
+    TIM2_DIER |= CC1IE;
+
+    // The counter may have gone past it while arming
+    if (clock_us() >= us)
+        TIM2_EGR = CC1G;
 }
@@ -0,0 +1,24 @@
+#include "cycles.h"
+
+#include "sysclk.h"
+
+#define DEMCR (*((volatile uint32_t *)0xE000EDFC))
+#define DWT_CTRL (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT (*((volatile uint32_t *)0xE0001004))
+
+#define TRCENA (1 << 24)
+#define CYCCNTENA 1
+
+void cycles_init(void) {
+    DEMCR |= TRCENA;  // Enable the DWT
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= CYCCNTENA;
+}
+
+uint32_t cycles_get(void) {
+    return DWT_CYCCNT;
+}
+
+uint32_t cycles_to_us(uint32_t cycles) {
+    return cycles / (AHB_CLOCK_SPEED / 1000000);
+}
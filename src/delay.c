@@ -1,26 +1,26 @@
 #include "delay.h"
 
-#include <stdint.h>
+#include <stdbool.h>
 
-#include "sysclk.h"
-#include "systick.h"
+#include "idle.h"
+#include "swtimer.h"
 
-#define MAX_TICKS 0x00FFFFFF
+static void _done(void *arg) {
+    *(volatile bool *)arg = true;
+    idle_wake();
+}
 
+/* Sleeps on a one-shot timer, so other interrupts keep being served meanwhile.
+ * The tick under way when it starts is partly gone, so one more is waited. */
 void delay(int ms) {
-    long ticks = (ms * (AHB_CLOCK_SPEED / 1000)) - 1;
-
-    /* The RELOAD register has a max value it can hold
-     * If the wanted delay is greater than this max,
-     * have to repeat the delay multiple times */
-    while (ticks > 0) {
-        STRELOAD |= (ticks > MAX_TICKS ? MAX_TICKS : ticks);
-        STCURRENT = 0;
-        STCTRL |= 0x05;
+    volatile bool done = false;
+    SWTIMER timer = {0};
 
-        while (!(STCTRL & 0x10000))
-            ;
-
-        ticks -= MAX_TICKS;
+    if (ms <= 0) {
+        return;
     }
+
+    swtimer_start(&timer, ms + 1, 0, _done, (void *)&done);
+    while (!done)
+        idle_until(IDLE_FOREVER);
 }
@@ -1,9 +1,11 @@
 #include "display.h"
 
 #include <ctype.h>
+#include <stdbool.h>
 
 #include "delay.h"
 #include "gpio.h"
+#include "spi.h"
 
 // CS: B12
 // SCK: B13
@@ -11,15 +13,8 @@
 // SDA: B15
 // RST: B14
 
-#define SPI_CLK (1 << 14)
-#define SPI2_START 0x40003800
-#define SPI2_CR1 (*((volatile uint32_t *)(SPI2_START + 0x00)))
-#define SPI2_CR2 (*((volatile uint32_t *)(SPI2_START + 0x04)))
-#define SPI2_SR (*((volatile uint32_t *)(SPI2_START + 0x08)))
-#define SPI2_DR (*((volatile uint32_t *)(SPI2_START + 0x0C)))
-
-#define A0 (1 << 8)
-#define RST (1 << 14)
+#define A0 8
+#define RST 14
 
 #define SET_PAGE_ADDR 0xB0
 #define SET_COL_ADDR_MSB 0x10
@@ -99,35 +94,16 @@ static const uint8_t *_char_to_bits(char c) {
 }
 
 static void _gpio_init(void) {
-    // Disable reset state
-    GPIOA_CRH &= ~(1 << 2);
-    GPIOB_CRH &= ~((1 << 18) | (1 << 22) | (1 << 26) | (1 << 30));
-
-    // MODEy (A8, B12, B13, B14, B15 2MHz out)
-    GPIOA_CRH |= (1 << 1);
-    GPIOB_CRH |= ((1 << 17) | (1 << 21) | (1 << 25) | (1 << 29));
-
-    // CNFy (B12, B13, B15 alt out, A8, B14 gpo)
-    GPIOB_CRH |= ((1 << 19) | (1 << 23) | (1 << 31));
-}
-
-static void _spi_init(void) {
-    RCC_APB1ENR |= SPI_CLK;
-    for (volatile int i = 0; i < 10; i++)
-        ;
-
-    SPI2_CR1 |= (3 << 3);   // CLK / 16 (fastest speed that works)
-    SPI2_CR2 |= (1 << 2);   // Enable SS output
-    SPI2_CR1 |= (1 << 15);  // 1 line mode
-    SPI2_CR1 |= (1 << 14);  // Transmit-only
-    SPI2_CR1 |= (1 << 2);   // Set as master
-    SPI2_CR1 |= (1 << 6);   // Enable
+    // B12, B13, B15 alt out (CS, SCK, SDA), A8, B14 gpo (A0, RST)
+    gpio_set_mode(GPIOB, 12, GPIO_ALT_OUT);
+    gpio_set_mode(GPIOB, 13, GPIO_ALT_OUT);
+    gpio_set_mode(GPIOB, 15, GPIO_ALT_OUT);
+    gpio_set_mode(GPIOA, A0, GPIO_OUT);
+    gpio_set_mode(GPIOB, RST, GPIO_OUT);
 }
 
 static void _display_write(uint8_t data) {
-    SPI2_DR = data;
-    while (!(SPI2_SR & 0x02))
-        ;
+    spi_write(SPI2, data);
     for (volatile int i = 0; i < 10; i++)
         ;  // Need a very brief delay
 }
@@ -145,12 +121,12 @@ void display_init(void) {
     _gpio_init();
 
     // Perform hardware reset of display
-    GPIOB_ODR &= ~RST;
+    gpio_write(GPIOB, RST, false);
     delay(5);
-    GPIOB_ODR |= RST;
+    gpio_write(GPIOB, RST, true);
     delay(1);
 
-    _spi_init();
+    spi_init(SPI2, SPI_DIV_16, SPI_TX_ONLY);  // Fastest speed that works
 
     // Voltage stuff
     // Not entirely sure why this is needed
@@ -163,12 +139,12 @@ void display_init(void) {
 }
 
 void display_send_data(uint8_t data) {
-    GPIOA_ODR |= A0;
+    gpio_write(GPIOA, A0, true);
     _display_write(data);
 }
 
 void display_send_cmd(uint8_t cmd) {
-    GPIOA_ODR &= ~A0;
+    gpio_write(GPIOA, A0, false);
     _display_write(cmd);
 }
 
@@ -184,26 +160,87 @@ void display_clear(void) {
     }
 }
 
-void display_draw(uint8_t buf[64][16]) {
-    for (int y = 0; y < NUM_PAGES; y++) {
-        display_send_cmd(SET_PAGE_ADDR | y);
-        display_send_cmd(SET_COL_ADDR_MSB);
-        display_send_cmd(SET_COL_ADDR_LSB);
+// Sends columns first_col..last_col of a page, transposed into vertical bytes.
+static void _draw_span(const uint8_t buf[64][16], int page, int first_col, int last_col) {
+    display_send_cmd(SET_PAGE_ADDR | page);
+    display_send_cmd(SET_COL_ADDR_MSB | (first_col >> 4));
+    display_send_cmd(SET_COL_ADDR_LSB | (first_col & 0x0F));
 
-        for (int x = 0; x < NUM_COLS; x++) {
-            int row = NUM_PAGES * y;
-            uint8_t data = 0;
+    int row = NUM_PAGES * page;
+    for (int x = first_col; x <= last_col; x++) {
+        uint8_t data = 0;
 
-            for (int i = 0; i < 8; i++) {
-                uint8_t bit = (buf[row + i][x / 8]) & (1 << (7 - (x % 8)));
+        for (int i = 0; i < 8; i++) {
+            uint8_t bit = (buf[row + i][x / 8]) & (1 << (7 - (x % 8)));
 
-                if (bit) {
-                    data |= (1 << i);
-                }
+            if (bit) {
+                data |= (1 << i);
             }
+        }
+
+        display_send_data(data);
+    }
+}
+
+// Sends columns first_col..last_col of a page that is already in display order.
+static void _draw_page_span(const uint8_t buf[8][128], int page, int first_col, int last_col) {
+    display_send_cmd(SET_PAGE_ADDR | page);
+    display_send_cmd(SET_COL_ADDR_MSB | (first_col >> 4));
+    display_send_cmd(SET_COL_ADDR_LSB | (first_col & 0x0F));
+
+    gpio_write(GPIOA, A0, true);
+    for (int x = first_col; x <= last_col; x++) {
+        _display_write(buf[page][x]);
+    }
+}
 
-            display_send_data(data);
+/* Finds each run of changed 8-column bands in a page so it can be sent with a
+single column address. Returns false once the page has no runs left. */
+static bool _next_span(uint16_t *bands, int *band, int *first_col, int *last_col) {
+    if (!*bands) {
+        return false;
+    }
+
+    while (!(*bands & 1)) {
+        *bands >>= 1;
+        (*band)++;
+    }
+
+    *first_col = *band * 8;
+    while (*bands & 1) {
+        *bands >>= 1;
+        (*band)++;
+    }
+
+    *last_col = (*band * 8) - 1;
+    return true;
+}
+
+void display_draw(const uint8_t buf[64][16], uint16_t dirty[8]) {
+    for (int y = 0; y < NUM_PAGES; y++) {
+        uint16_t bands = dirty[y];
+        int band = 0;
+        int first, last;
+
+        while (_next_span(&bands, &band, &first, &last)) {
+            _draw_span(buf, y, first, last);
         }
+
+        dirty[y] = 0;
+    }
+}
+
+void display_draw_pages(const uint8_t buf[8][128], uint16_t dirty[8]) {
+    for (int y = 0; y < NUM_PAGES; y++) {
+        uint16_t bands = dirty[y];
+        int band = 0;
+        int first, last;
+
+        while (_next_span(&bands, &band, &first, &last)) {
+            _draw_page_span(buf, y, first, last);
+        }
+
+        dirty[y] = 0;
     }
 }
 
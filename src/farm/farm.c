@@ -0,0 +1,308 @@
+#include "farm.h"
+
+#include <dirent.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json.h"
+
+/* Runs ROMs headless on every core and prints what they did as JSON.
+
+Usage: program [-t secs] [-c checkpoint_ms] [-j threads] [-r] [-s seed]
+               [-f cpu_freq] [-q quirks] [-p] [-w] path ...
+
+A path is a directory of .ch8 ROMs, a single .ch8 ROM or a cartridge image.
+A ROM's metadata block is read from the .meta file next to it if there is one
+(or from its slot of a cartridge image); otherwise the defaults are used with
+-f and -q. Every ROM is played for secs of emulated time with the scripted
+input, or with random buttons with -r.
+
+With -p, ROMs with an input recording (a .rpl file next to the ROM, or in its
+cartridge slot) are played with it instead. With -w, the input of the other
+.ch8 ROMs is recorded to their .rpl files (see replay.h). */
+
+static FARM_JOB *jobs = NULL;
+static int num_jobs = 0;
+static int max_jobs = 0;
+
+// Reads a whole recording into memory, a block at a time.
+static void _load_replay(FARM_JOB *job, FILE *f, uint32_t max_blocks) {
+    uint8_t block[SD_BLOCK_SIZE];
+
+    while (job->replay_blocks < max_blocks && fread(block, 1, sizeof(block), f) == sizeof(block)) {
+        job->replay = realloc(job->replay, (job->replay_blocks + 1) * SD_BLOCK_SIZE);
+        memcpy(&job->replay[job->replay_blocks++ * SD_BLOCK_SIZE], block, sizeof(block));
+    }
+}
+
+static FARM_JOB *_add_job(const char *name) {
+    if (num_jobs == max_jobs) {
+        max_jobs = max_jobs ? max_jobs * 2 : 64;
+        jobs = realloc(jobs, max_jobs * sizeof(FARM_JOB));
+    }
+
+    FARM_JOB *job = &jobs[num_jobs++];
+    memset(job, 0, sizeof(*job));
+    snprintf(job->name, sizeof(job->name), "%s", name);
+
+    return job;
+}
+
+static bool _ends_with(const char *str, const char *suffix) {
+    size_t len = strlen(str);
+    size_t suffix_len = strlen(suffix);
+
+    return len >= suffix_len && !strcmp(str + len - suffix_len, suffix);
+}
+
+static void _load_rom(const char *path, uint32_t cpu_freq, uint8_t quirks) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "can't open %s\n", path);
+        return;
+    }
+
+    FARM_JOB *job = _add_job(path);
+    job->size = fread(job->rom, 1, sizeof(job->rom), f);
+    fclose(f);
+
+    snprintf(job->replay_path, sizeof(job->replay_path), "%.*s.rpl", (int)(strlen(path) - 4), path);
+    f = fopen(job->replay_path, "rb");
+    if (f) {
+        _load_replay(job, f, UINT32_MAX);
+        fclose(f);
+    }
+
+    // The .meta file next to the ROM, if any.
+    char meta_path[FARM_MAX_NAME];
+    snprintf(meta_path, sizeof(meta_path), "%.*s.meta", (int)(strlen(path) - 4), path);
+
+    f = fopen(meta_path, "rb");
+    if (f) {
+        size_t read = fread(job->metadata, 1, sizeof(job->metadata), f);
+        fclose(f);
+
+        if (read == sizeof(job->metadata) && cartridge_parse(job->metadata, &job->meta)) {
+            return;
+        }
+        fprintf(stderr, "%s holds no metadata, using the defaults\n", meta_path);
+    }
+
+    cartridge_default(&job->meta);
+    job->meta.cpu_freq = cpu_freq;
+    for (int i = 0; i < NUM_QUIRKS; i++) {
+        job->meta.quirks[i] = (quirks >> i) & 1;
+    }
+}
+
+static int _compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Loads every .ch8 in a directory, in name order.
+static void _load_dir(const char *path, uint32_t cpu_freq, uint8_t quirks) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        fprintf(stderr, "can't open %s\n", path);
+        return;
+    }
+
+    char **names = NULL;
+    int num_names = 0;
+    struct dirent *entry;
+
+    while ((entry = readdir(dir))) {
+        if (_ends_with(entry->d_name, ".ch8")) {
+            names = realloc(names, (num_names + 1) * sizeof(char *));
+            names[num_names++] = strdup(entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    qsort(names, num_names, sizeof(char *), _compare_names);
+
+    for (int i = 0; i < num_names; i++) {
+        char rom_path[FARM_MAX_NAME];
+        snprintf(rom_path, sizeof(rom_path), "%s/%s", path, names[i]);
+        _load_rom(rom_path, cpu_freq, quirks);
+        free(names[i]);
+    }
+    free(names);
+}
+
+// Loads every ROM on a cartridge image.
+static void _load_cartridge(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "can't open %s\n", path);
+        return;
+    }
+
+    uint8_t block[SD_BLOCK_SIZE];
+    for (int slot = 0; fread(block, 1, sizeof(block), f) == sizeof(block); slot++) {
+        CARTRIDGE_META meta;
+        long rom_pos = ftell(f);
+
+        if (cartridge_parse(block, &meta)) {
+            char name[FARM_MAX_NAME];
+            snprintf(name, sizeof(name), "%s#%d", path, slot);
+
+            FARM_JOB *job = _add_job(name);
+            memcpy(job->metadata, block, sizeof(block));
+            job->meta = meta;
+
+            // The ROM stops where an input recording starts.
+            int rom_blocks = meta.replay_block ? meta.replay_block - 1 : CARTRIDGE_ROM_BLOCKS;
+            job->size = fread(job->rom, 1, rom_blocks * SD_BLOCK_SIZE, f);
+
+            if (meta.replay_block) {
+                _load_replay(job, f, CARTRIDGE_SLOT_BLOCKS - meta.replay_block);
+            }
+        }
+
+        fseek(f, rom_pos + (CARTRIDGE_ROM_BLOCKS * SD_BLOCK_SIZE), SEEK_SET);
+    }
+
+    fclose(f);
+}
+
+static void _load(const char *path, uint32_t cpu_freq, uint8_t quirks) {
+    struct stat st;
+
+    if (stat(path, &st)) {
+        fprintf(stderr, "can't open %s\n", path);
+    } else if (S_ISDIR(st.st_mode)) {
+        _load_dir(path, cpu_freq, quirks);
+    } else if (_ends_with(path, ".ch8")) {
+        _load_rom(path, cpu_freq, quirks);
+    } else {
+        _load_cartridge(path);
+    }
+}
+
+typedef struct {
+    FARM_WORKER *workers;
+    const FARM_OPTS *opts;
+} FARM;
+
+static void _work(int worker, int job, void *arg) {
+    FARM *farm = arg;
+    farm_run(&farm->workers[worker], &jobs[job], farm->opts);
+}
+
+static void _print_job(const FARM_JOB *job) {
+    static const char *const replay_modes[] = {"none", "recorded", "played"};
+    uint8_t quirks = 0;
+
+    for (int i = 0; i < NUM_QUIRKS; i++) {
+        quirks |= job->meta.quirks[i] << i;
+    }
+
+    // Rates are 0 rather than inf (which isn't JSON) if no time was measured
+    double secs = job->ns / 1e9;
+
+    printf("{\"name\": ");
+    json_print_string(stdout, job->name);
+    printf(", \"title\": ");
+    json_print_string(stdout, job->meta.title);
+    printf(", \"cpu_freq\": %lu, \"quirks\": \"0x%02X\", "
+           "\"instructions\": %llu, \"idle_instructions\": %llu, \"frames\": %llu, "
+           "\"instructions_per_sec\": %.0f, \"traps\": %lu, \"last_trap\": \"0x%04X\", "
+           "\"exit_ms\": %ld, \"replay\": \"%s\", \"hashes\": [",
+           (unsigned long)job->meta.cpu_freq, quirks, (unsigned long long)job->instrs,
+           (unsigned long long)job->idle_instrs, (unsigned long long)job->frames,
+           secs > 0 ? job->instrs / secs : 0, (unsigned long)job->num_traps, job->last_trap,
+           job->exit_ms, replay_modes[job->replay_mode]);
+
+    for (int i = 0; i < job->num_hashes; i++) {
+        printf(i ? ", \"%08X\"" : "\"%08X\"", job->hashes[i]);
+    }
+    printf("]}");
+}
+
+int main(int argc, char **argv) {
+    FARM_OPTS opts = {.run_ms = FARM_RUN_SECS_DEFAULT * ONE_SEC,
+                      .checkpoint_ms = FARM_CHECKPOINT_MS_DEFAULT,
+                      .seed = RAND_SEED_DEFAULT};
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t cpu_freq = CPU_FREQ_DEFAULT;
+    uint8_t quirks = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:c:j:rs:f:q:pw")) != -1) {
+        switch (opt) {
+        case 't':
+            opts.run_ms = strtol(optarg, NULL, 0) * ONE_SEC;
+            break;
+        case 'c':
+            opts.checkpoint_ms = strtol(optarg, NULL, 0);
+            break;
+        case 'j':
+            num_threads = strtol(optarg, NULL, 0);
+            break;
+        case 'r':
+            opts.random_input = true;
+            break;
+        case 's':
+            opts.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            cpu_freq = strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            quirks = strtoul(optarg, NULL, 16);
+            break;
+        case 'p':
+            opts.play_replays = true;
+            break;
+        case 'w':
+            opts.write_replays = true;
+            break;
+        default:
+            optind = argc + 1;
+        }
+    }
+
+    if (optind >= argc || opts.checkpoint_ms <= 0) {
+        fprintf(stderr, "usage: %s [-t secs] [-c checkpoint_ms] [-j threads] [-r] [-s seed] "
+                        "[-f cpu_freq] [-q quirks] [-p] [-w] path ...\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        _load(argv[i], cpu_freq, quirks);
+    }
+
+    if (num_threads < 1) {
+        num_threads = 1;
+    } else if (num_threads > num_jobs) {
+        num_threads = num_jobs ? num_jobs : 1;
+    }
+
+    FARM farm = {calloc(num_threads, sizeof(FARM_WORKER)), &opts};
+    farm_pool_run(num_threads, num_jobs, _work, &farm);
+    free(farm.workers);
+
+    printf("{\n  \"run_ms\": %ld,\n  \"checkpoint_ms\": %ld,\n  \"input\": \"%s\",\n"
+           "  \"seed\": %lu,\n  \"threads\": %d,\n  \"roms\": [",
+           opts.run_ms, opts.checkpoint_ms, opts.random_input ? "random" : "scripted",
+           (unsigned long)opts.seed, num_threads);
+
+    for (int i = 0; i < num_jobs; i++) {
+        printf(i ? ",\n    " : "\n    ");
+        _print_job(&jobs[i]);
+    }
+
+    printf("\n  ]\n}\n");
+
+    for (int i = 0; i < num_jobs; i++) {
+        free(jobs[i].replay);
+    }
+    free(jobs);
+
+    return 0;
+}
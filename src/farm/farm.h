@@ -0,0 +1,94 @@
+#ifndef FARM_H
+#define FARM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cartridge.h"
+#include "chip8.h"
+#include "replay.h"
+#include "sd.h"
+
+// Emulated time each ROM runs for, in seconds.
+#define FARM_RUN_SECS_DEFAULT 10
+
+// Emulated time between display hashes, in ms.
+#define FARM_CHECKPOINT_MS_DEFAULT 1000
+
+// Most display hashes kept per ROM.
+#define FARM_MAX_CHECKPOINTS 256
+
+// Input: a button is pressed every FARM_KEY_PERIOD ms and held for FARM_KEY_HOLD ms.
+#define FARM_KEY_PERIOD 200
+#define FARM_KEY_HOLD 80
+
+#define FARM_MAX_NAME 256
+
+// Most blocks of a recording written to a host file.
+#define FARM_REPLAY_BLOCKS 64
+
+typedef struct FARM_OPTS {
+    long run_ms;
+    long checkpoint_ms;
+
+    // Press random buttons (from seed) rather than the scripted sequence.
+    bool random_input;
+
+    // Seeds Cxkk and the random input.
+    uint32_t seed;
+
+    // Play back the ROMs' recordings, and record the input of those without.
+    bool play_replays;
+    bool write_replays;
+} FARM_OPTS;
+
+// A ROM to run and what running it found.
+typedef struct FARM_JOB {
+    char name[FARM_MAX_NAME];
+    uint8_t rom[MAX_RAM - PC_START_ADDR_DEFAULT];
+    size_t size;
+    uint8_t metadata[SD_BLOCK_SIZE];
+    CARTRIDGE_META meta;
+
+    /* The ROM's input recording (from a .rpl file or its cartridge slot), and
+    where to write one. replay_path is empty for cartridge slots. */
+    uint8_t *replay;
+    uint32_t replay_blocks;
+    char replay_path[FARM_MAX_NAME];
+
+    // Whether the run played or recorded the input.
+    REPLAY_MODE replay_mode;
+
+    uint64_t instrs;
+    uint64_t idle_instrs;
+    uint64_t frames;
+    uint64_t ns;
+
+    // FNV-1a hash of the display at every checkpoint.
+    uint32_t hashes[FARM_MAX_CHECKPOINTS];
+    int num_hashes;
+
+    uint32_t num_traps;
+    uint16_t last_trap;
+
+    // Emulated time the ROM exited (00FD) at, or -1.
+    long exit_ms;
+} FARM_JOB;
+
+// An emulator and the virtual time it runs on, used by one thread.
+typedef struct FARM_WORKER {
+    CHIP8 chip8;
+    REPLAY replay;
+    uint32_t now_ms;
+} FARM_WORKER;
+
+// Runs a job headless on a worker's emulator, filling in its results.
+void farm_run(FARM_WORKER *worker, FARM_JOB *job, const FARM_OPTS *opts);
+
+/* Runs num_jobs jobs on num_workers threads. Jobs are dealt out evenly and a
+thread that runs out steals from the others. */
+typedef void (*FARM_WORK)(int worker, int job, void *arg);
+void farm_pool_run(int num_workers, int num_jobs, FARM_WORK work, void *arg);
+
+#endif
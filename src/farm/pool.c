@@ -0,0 +1,111 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "farm.h"
+
+/* Each thread owns a deque of job indices. It takes from the back of its own
+and steals from the front of the others' once it runs dry. Jobs never spawn
+more jobs, so a thread that finds every deque empty is done. */
+typedef struct {
+    pthread_mutex_t lock;
+    int *jobs;
+    int head;
+    int tail;
+} DEQUE;
+
+typedef struct {
+    DEQUE *deques;
+    int num_workers;
+    FARM_WORK work;
+    void *arg;
+} POOL;
+
+typedef struct {
+    POOL *pool;
+    int id;
+} THREAD;
+
+static bool _pop(DEQUE *d, int *job) {
+    bool found = false;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail) {
+        *job = d->jobs[--d->tail];
+        found = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    return found;
+}
+
+static bool _steal(DEQUE *d, int *job) {
+    bool found = false;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail) {
+        *job = d->jobs[d->head++];
+        found = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    return found;
+}
+
+static bool _next_job(POOL *pool, int id, int *job) {
+    if (_pop(&pool->deques[id], job)) {
+        return true;
+    }
+
+    for (int i = 1; i < pool->num_workers; i++) {
+        if (_steal(&pool->deques[(id + i) % pool->num_workers], job)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void *_worker(void *arg) {
+    THREAD *t = arg;
+    int job;
+
+    while (_next_job(t->pool, t->id, &job)) {
+        t->pool->work(t->id, job, t->pool->arg);
+    }
+
+    return NULL;
+}
+
+void farm_pool_run(int num_workers, int num_jobs, FARM_WORK work, void *arg) {
+    POOL pool = {calloc(num_workers, sizeof(DEQUE)), num_workers, work, arg};
+    pthread_t *threads = calloc(num_workers, sizeof(pthread_t));
+    THREAD *args = calloc(num_workers, sizeof(THREAD));
+
+    for (int i = 0; i < num_workers; i++) {
+        DEQUE *d = &pool.deques[i];
+        pthread_mutex_init(&d->lock, NULL);
+        d->jobs = calloc((num_jobs / num_workers) + 1, sizeof(int));
+
+        // Deal in reverse so each thread pops its jobs in order.
+        for (int j = num_jobs - 1; j >= 0; j--) {
+            if (j % num_workers == i) {
+                d->jobs[d->tail++] = j;
+            }
+        }
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        args[i] = (THREAD){&pool, i};
+        pthread_create(&threads[i], NULL, _worker, &args[i]);
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(threads[i], NULL);
+        pthread_mutex_destroy(&pool.deques[i].lock);
+        free(pool.deques[i].jobs);
+    }
+
+    free(args);
+    free(threads);
+    free(pool.deques);
+}
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "farm.h"
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+// Buttons the scripted input presses in turn.
+static const uint8_t script[] = {BTN_A_BIT, BTN_RIGHT_BIT, BTN_A_BIT, BTN_LEFT_BIT,
+                                 BTN_UP_BIT, BTN_DOWN_BIT, BTN_B_BIT, BTN_A_BIT};
+
+static uint32_t _clock(void *ctx) {
+    return ((FARM_WORKER *)ctx)->now_ms;
+}
+
+// Recordings are kept in the job's memory, blocks past the end reading as zeros.
+static bool _replay_read(void *ctx, uint32_t block, uint8_t *data) {
+    FARM_JOB *job = ctx;
+
+    if (block < job->replay_blocks) {
+        memcpy(data, &job->replay[block * SD_BLOCK_SIZE], SD_BLOCK_SIZE);
+    } else {
+        memset(data, 0, SD_BLOCK_SIZE);
+    }
+
+    return true;
+}
+
+static bool _replay_write(void *ctx, uint32_t block, const uint8_t *data) {
+    FARM_JOB *job = ctx;
+
+    if (block >= job->replay_blocks) {
+        job->replay = realloc(job->replay, (block + 1) * SD_BLOCK_SIZE);
+        memset(&job->replay[job->replay_blocks * SD_BLOCK_SIZE], 0,
+               (block + 1 - job->replay_blocks) * SD_BLOCK_SIZE);
+        job->replay_blocks = block + 1;
+    }
+    memcpy(&job->replay[block * SD_BLOCK_SIZE], data, SD_BLOCK_SIZE);
+
+    return true;
+}
+
+// Plays the job's recording, or starts recording one, as asked.
+static void _start_replay(REPLAY *replay, FARM_JOB *job, CHIP8 *chip8, const FARM_OPTS *opts) {
+    REPLAY_STORE store = {_replay_read, _replay_write, job, job->replay_blocks};
+
+    replay->mode = REPLAY_OFF;
+    job->replay_mode = REPLAY_OFF;
+
+    if (opts->play_replays && replay_play(replay, &store, chip8)) {
+        job->replay_mode = REPLAY_PLAY;
+    } else if (opts->write_replays && job->replay_path[0] && !replay_exists(&store)) {
+        free(job->replay);
+        job->replay = NULL;
+        job->replay_blocks = 0;
+
+        store.num_blocks = FARM_REPLAY_BLOCKS;
+        if (replay_record(replay, &store, chip8)) {
+            job->replay_mode = REPLAY_RECORD;
+        }
+    }
+}
+
+static void _save_replay(const FARM_JOB *job) {
+    FILE *f = fopen(job->replay_path, "wb");
+    if (!f) {
+        fprintf(stderr, "can't write %s\n", job->replay_path);
+        return;
+    }
+
+    fwrite(job->replay, SD_BLOCK_SIZE, job->replay_blocks, f);
+    fclose(f);
+}
+
+static uint64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static uint32_t _xorshift(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return *state = x;
+}
+
+/* Hashes the display as the LCD shows it, a row at a time, so hashes don't
+depend on the framebuffer layout. */
+static uint32_t _hash_display(CHIP8 *chip8) {
+    uint32_t hash = FNV_OFFSET;
+
+    chip8_mark_display_dirty(chip8);
+    chip8_present(chip8);
+
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        for (int x = 0; x < DISPLAY_WIDTH; x += 8) {
+            uint8_t byte = 0;
+            for (int b = 0; b < 8; b++) {
+                byte = (byte << 1) | chip8_get_pixel(chip8->display, x + b, y);
+            }
+
+            hash = (hash ^ byte) * FNV_PRIME;
+        }
+    }
+
+    return hash;
+}
+
+// Returns the buttons held down at time t.
+static uint8_t _buttons(long t, bool random, uint32_t *rand_state, uint8_t held) {
+    if (t % FARM_KEY_PERIOD == FARM_KEY_HOLD) {
+        return 0;
+    } else if (t % FARM_KEY_PERIOD) {
+        return held;
+    } else if (random) {
+        return 1 << (_xorshift(rand_state) % NUM_BUTTONS);
+    }
+
+    return script[(t / FARM_KEY_PERIOD) % sizeof(script)];
+}
+
+void farm_run(FARM_WORKER *worker, FARM_JOB *job, const FARM_OPTS *opts) {
+    CHIP8 *chip8 = &worker->chip8;
+    const CARTRIDGE_META *meta = &job->meta;
+    CHIP8_HOOKS hooks = {.clock = _clock, .ctx = worker};
+    uint32_t rand_state = opts->seed ? opts->seed : RAND_SEED_DEFAULT;
+    uint8_t held = 0;
+    uint32_t frame_freq = meta->timer_freq ? meta->timer_freq : TIMER_FREQ_DEFAULT;
+
+    // Start from a clean machine so results don't depend on the jobs run before.
+    memset(chip8, 0, sizeof(*chip8));
+    worker->now_ms = 0;
+    chip8_init(chip8, meta->cpu_freq, meta->timer_freq, meta->refresh_freq,
+               PC_START_ADDR_DEFAULT, meta->quirks, job->metadata, 0, &hooks);
+    chip8_seed(chip8, opts->seed);
+    chip8_set_timer_ticks(chip8, meta->frame_sliced);
+    chip8_load_font(chip8);
+
+    memcpy(&chip8->RAM[PC_START_ADDR_DEFAULT], job->rom, job->size);
+    chip8_invalidate(chip8, PC_START_ADDR_DEFAULT, job->size);
+
+    _start_replay(&worker->replay, job, chip8, opts);
+
+    job->frames = 0;
+    job->num_hashes = 0;
+    job->exit_ms = -1;
+
+    uint64_t start = _now_ns();
+
+    for (long t = 0; t < opts->run_ms; t++) {
+        worker->now_ms++;
+
+        // A played recording is the only input, even once it has run out.
+        uint8_t btns = _buttons(t, opts->random_input, &rand_state, held);
+        if (job->replay_mode == REPLAY_PLAY) {
+            btns = held;
+        }
+        replay_input(&worker->replay, chip8, cartridge_btns_to_keys(meta, btns & ~held),
+                     cartridge_btns_to_keys(meta, held & ~btns));
+        held = btns;
+
+        if (!meta->frame_sliced) {
+            chip8_cycle(chip8);
+
+            if (chip8->display_updated) {
+                job->frames++;
+            }
+        } else if ((uint64_t)worker->now_ms * frame_freq >= job->frames * ONE_SEC) {
+            // Frames start at exact multiples of the frame period.
+            chip8_frame(chip8);
+            job->frames++;
+        }
+
+        if ((t + 1) % opts->checkpoint_ms == 0 && job->num_hashes < FARM_MAX_CHECKPOINTS) {
+            job->hashes[job->num_hashes++] = _hash_display(chip8);
+        }
+
+        if (chip8->exit) {
+            job->exit_ms = t + 1;
+            break;
+        }
+    }
+
+    job->ns = _now_ns() - start;
+
+    if (job->replay_mode == REPLAY_RECORD) {
+        replay_stop(&worker->replay);
+        _save_replay(job);
+    }
+
+    job->instrs = chip8->num_instrs;
+    job->idle_instrs = chip8->num_idle_instrs;
+    job->num_traps = chip8->num_traps;
+    job->last_trap = chip8->last_trap;
+}
@@ -0,0 +1,133 @@
+#include "frameprof.h"
+
+#if FRAME_PROFILE
+
+#include <stdbool.h>
+
+#include "clock.h"
+#include "cycles.h"
+#include "uart.h"
+
+static FRAME_PHASE cur_phase = FRAME_PROFILER;
+static uint32_t phase_start = 0;
+
+/* Cycles spent in each phase this frame. FRAME_IDLE is timed in us on the
+clock instead, as the cycle counter stops while the core sleeps. */
+static uint32_t phase_cycles[NUM_FRAME_PHASES];
+static uint64_t idle_start = 0;
+static uint32_t idle_time = 0;
+static uint16_t loops = 0;
+static uint16_t frame_num = 0;
+
+// Time of each phase (us) in the last FRAMEPROF_WINDOW frames.
+static uint16_t window[FRAMEPROF_WINDOW][NUM_FRAME_PHASES];
+static int window_len = 0;
+static int window_pos = 0;
+
+static void _send_record(uint8_t type, const uint16_t *values, int num_values) {
+    uint8_t sum = 0;
+
+    uart_write(FRAMEPROF_SYNC);
+    uart_write(type);
+    uart_write(num_values * 2);
+
+    for (int i = 0; i < num_values; i++) {
+        uint8_t lo = values[i] & 0xFF;
+        uint8_t hi = values[i] >> 8;
+
+        uart_write(lo);
+        uart_write(hi);
+        sum += lo + hi;
+    }
+
+    uart_write(sum);
+}
+
+static void _send_window(void) {
+    uint16_t values[1 + (NUM_FRAME_PHASES * 3)];
+    values[0] = window_len;
+
+    for (int p = 0; p < NUM_FRAME_PHASES; p++) {
+        uint16_t min = 0xFFFF;
+        uint16_t max = 0;
+        uint32_t total = 0;
+
+        for (int f = 0; f < window_len; f++) {
+            uint16_t us = window[f][p];
+
+            min = (us < min) ? us : min;
+            max = (us > max) ? us : max;
+            total += us;
+        }
+
+        values[1 + (p * 3)] = min;
+        values[2 + (p * 3)] = total / window_len;
+        values[3 + (p * 3)] = max;
+    }
+
+    _send_record(FRAMEPROF_WINDOW_RECORD, values, 1 + (NUM_FRAME_PHASES * 3));
+}
+
+void frameprof_init(void) {
+    uart_init(FRAMEPROF_BAUD);
+
+    cycles_init();
+    cur_phase = FRAME_PROFILER;
+    phase_start = cycles_get();
+}
+
+FRAME_PHASE frameprof_phase(FRAME_PHASE phase) {
+    uint32_t now = cycles_get();
+    FRAME_PHASE prev = cur_phase;
+
+    if (prev == FRAME_IDLE) {
+        idle_time += clock_us() - idle_start;
+    } else {
+        phase_cycles[prev] += now - phase_start;
+    }
+    if (phase == FRAME_IDLE) {
+        idle_start = clock_us();
+    }
+
+    phase_start = now;
+    cur_phase = phase;
+
+    if (phase == FRAME_INPUT) {
+        loops++;
+    }
+
+    return prev;
+}
+
+void frameprof_end_frame(void) {
+    // Sending the records counts towards the next frame
+    frameprof_phase(FRAME_PROFILER);
+
+    uint16_t values[2 + NUM_FRAME_PHASES];
+    values[0] = frame_num++;
+    values[1] = loops;
+
+    for (int p = 0; p < NUM_FRAME_PHASES; p++) {
+        uint32_t us = (p == FRAME_IDLE) ? idle_time : cycles_to_us(phase_cycles[p]);
+        values[2 + p] = (us > 0xFFFF) ? 0xFFFF : us;
+
+        window[window_pos][p] = values[2 + p];
+        phase_cycles[p] = 0;
+    }
+
+    idle_time = 0;
+    loops = 0;
+    window_pos = (window_pos + 1) % FRAMEPROF_WINDOW;
+    if (window_len < FRAMEPROF_WINDOW) {
+        window_len++;
+    }
+
+    _send_record(FRAMEPROF_FRAME_RECORD, values, 2 + NUM_FRAME_PHASES);
+
+    // The window rolls every frame, but its stats only go out once per window
+    if (window_pos == 0) {
+        _send_window();
+    }
+}
+
+#endif
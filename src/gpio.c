@@ -26,3 +26,39 @@ void gpio_init(GPIO port) {
     for (volatile int i = 0; i < 10; i++)
         ;
 }
+
+// Base address of each port's registers (only A-C are bonded out).
+static const uint32_t port_start[] = {GPIOA_START, GPIOB_START, 0x40011000};
+
+#define GPIO_CR(port, pin) (*((volatile uint32_t *)(port_start[port] + ((pin) < 8 ? 0x00 : 0x04))))
+#define GPIO_IDR(port) (*((volatile uint32_t *)(port_start[port] + 0x08)))
+#define GPIO_ODR(port) (*((volatile uint32_t *)(port_start[port] + 0x0C)))
+
+void gpio_set_mode(GPIO port, int pin, GPIO_MODE mode) {
+    // Each pin has 4 bits in CRL/CRH: CNFy[1:0] then MODEy[1:0]
+    static const uint8_t cr_bits[] = {
+        [GPIO_OUT] = 0x02,
+        [GPIO_ALT_OUT] = 0x0A,
+        [GPIO_IN] = 0x04,
+        [GPIO_IN_PULLUP] = 0x08};
+    int shift = (pin % 8) * 4;
+
+    GPIO_CR(port, pin) = (GPIO_CR(port, pin) & ~(0x0F << shift)) | (cr_bits[mode] << shift);
+
+    // Pull-up/down is picked by the output bit
+    if (mode == GPIO_IN_PULLUP) {
+        gpio_write(port, pin, true);
+    }
+}
+
+void gpio_write(GPIO port, int pin, bool on) {
+    if (on) {
+        GPIO_ODR(port) |= (1 << pin);
+    } else {
+        GPIO_ODR(port) &= ~(1 << pin);
+    }
+}
+
+bool gpio_read(GPIO port, int pin) {
+    return GPIO_IDR(port) & (1 << pin);
+}
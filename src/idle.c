@@ -0,0 +1,38 @@
+#include "idle.h"
+
+#include <stdbool.h>
+
+#include "clock.h"
+
+static volatile bool wake_pending = false;
+static uint64_t slept_us = 0;
+
+void idle_until(uint64_t deadline) {
+    uint64_t start = clock_us();
+
+    /* Interrupts are masked between checking for a wake and sleeping, so one
+     * can't slip in between and be missed. WFI still wakes on a pending
+     * interrupt, which then runs once they are unmasked. */
+    __asm volatile("cpsid i" ::: "memory");
+
+    while (!wake_pending && clock_us() < deadline) {
+        clock_alarm(deadline);
+        __asm volatile("wfi");
+
+        __asm volatile("cpsie i" ::: "memory");
+        __asm volatile("cpsid i" ::: "memory");
+    }
+
+    wake_pending = false;
+    __asm volatile("cpsie i" ::: "memory");
+
+    slept_us += clock_us() - start;
+}
+
+void idle_wake(void) {
+    wake_pending = true;
+}
+
+uint64_t idle_us(void) {
+    return slept_us;
+}
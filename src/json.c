@@ -0,0 +1,17 @@
+#include "json.h"
+
+void json_print_string(FILE *f, const char *str) {
+    fputc('"', f);
+
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(f, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(f, "\\u%04x", *c);
+        } else {
+            fputc(*c, f);
+        }
+    }
+
+    fputc('"', f);
+}
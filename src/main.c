@@ -4,48 +4,113 @@
 #include <string.h>
 
 #include "buttons.h"
+#include "cartridge.h"
 #include "chip8.h"
 #include "clock.h"
 #include "delay.h"
 #include "display.h"
+#include "frameprof.h"
 #include "gpio.h"
+#include "idle.h"
 #include "led.h"
 #include "pwm.h"
+#include "replay.h"
+#include "savestate.h"
 #include "sd.h"
+#include "swtimer.h"
 #include "sysclk.h"
+#include "ticker.h"
 #include "uart.h"
 
-#define MAX_ROMS 25
+#define MAX_ROMS CARTRIDGE_MAX_ROMS
+
+// Buttons held together to save or load the game.
+#define SAVE_CHORD (BTN_A_BIT | BTN_B_BIT | BTN_UP_BIT)
+#define LOAD_CHORD (BTN_A_BIT | BTN_B_BIT | BTN_DOWN_BIT)
+
+// How long a save state error is shown over the game.
+#define SAVE_ERROR_MS 1000
+
+// How often to check for a cartridge, as the detect pin has no interrupt.
+#define SD_POLL_US 50000
+
+// The splash screen beeps SPLASH_BEEPS times, on and off every SPLASH_BEEP_MS.
+#define SPLASH_BEEPS 10
+#define SPLASH_BEEP_MS 100
 
 // Emulator (TODO: Put this all in struct)
 CHIP8 chip8;
 uint8_t metadata[SD_BLOCK_SIZE] = {0};
-char title[11];
-uint32_t cpu_freq = CPU_FREQ_DEFAULT;
-uint32_t timer_freq = TIMER_FREQ_DEFAULT;
-uint32_t refresh_freq = REFRESH_FREQ_DEFAULT;
-bool quirks[NUM_QUIRKS] = {0, 0, 0, 0, 0, 0, 0, 0};
-uint16_t BTN_LEFT_MAP = 0x90;
-uint16_t BTN_RIGHT_MAP = 0x240;
-uint16_t BTN_UP_MAP = 0x20;
-uint16_t BTN_DOWN_MAP = 0x100;
-uint16_t BTN_A_MAP = 0x00;
-uint16_t BTN_B_MAP = 0x40;
-bool play_sound = false;
+CARTRIDGE_META rom_meta;
+volatile bool play_sound = false;
 int rom_num = 0;
 
-// A basic splash screen that waits for user to press A
+/* While recording or replaying input, the emulator's clock moves exactly 1 ms
+per cycle and cycles are run until it has caught up with the real clock, so
+runs can be reproduced. */
+REPLAY replay;
+bool lockstep = false;
+uint32_t lockstep_start = 0;
+uint32_t emu_ms = 0;
+uint8_t held_btns = 0;
+
+// Whether the timers are ticked from the timer interrupt.
+bool timer_interrupt = false;
+
+/* The frame-sliced scheduler runs frame_num frames after frames_start (in us),
+and sleeps until the next is due. */
+bool frame_sliced = false;
+uint64_t frames_start = 0;
+uint32_t frame_num = 0;
+
+/* The splash screen's and menu's beeps are turned off by timers, so the
+cartridge can be brought up and the emulator started meanwhile. */
+SWTIMER splash_timer;
+SWTIMER beep_timer;
+int splash_toggles = 0;
+
+void splash_beep(void *arg) {
+    (void)arg;
+
+    if (splash_toggles++ % 2) {
+        pwm_stop();
+    } else {
+        pwm_start();
+    }
+
+    if (splash_toggles == SPLASH_BEEPS * 2) {
+        swtimer_stop(&splash_timer);
+        idle_wake();
+    }
+}
+
+// Leaves the buzzer to a game that has started sounding it.
+void end_beep(void *arg) {
+    (void)arg;
+
+    if (!play_sound)
+        pwm_stop();
+}
+
+void beep(int ms) {
+    pwm_start();
+    swtimer_start(&beep_timer, ms, 0, end_beep, NULL);
+}
+
+// A basic splash screen, which beeps while the caller gets on with starting up
 void show_splash(void) {
     display_print(37, 4, "CHIP N GO");
     // display_print(20, 4, "PRESS A TO PLAY");
     // display_print(20, 7, "CREATED BY KURT");
 
-    for (int i = 0; i < 10; i++) {
-        pwm_start();
-        delay(100);
-        pwm_stop();
-        delay(100);
-    }
+    splash_toggles = 0;
+    swtimer_start(&splash_timer, 1, SPLASH_BEEP_MS, splash_beep, NULL);
+}
+
+// Waits for the splash screen's beeps to finish, then clears it.
+void end_splash(void) {
+    while (swtimer_active(&splash_timer))
+        idle_until(IDLE_FOREVER);
 
     display_clear();
 
@@ -53,62 +118,88 @@ void show_splash(void) {
     // delay(2000);
 }
 
-void btn_to_key(uint16_t btn_map, CHIP8K action) {
-    for (int i = 0; i < 16; i++) {
-        if (btn_map & 1)
-            chip8.keypad[i] = action;
-        btn_map >>= 1;
-    }
+uint32_t emu_clock(void *ctx) {
+    (void)ctx;
+    return lockstep ? emu_ms : clock_get();
 }
 
-void parse_quirks(uint8_t q) {
-    for (int i = 0; i < 8; i++) {
-        quirks[i] = q & 1;
-        q >>= 1;
-    }
+// Writes the user flags back to the ROM's metadata block on the cartridge.
+void emu_save(void *ctx, uint8_t rom_num, const uint8_t *metadata) {
+    (void)ctx;
+    sd_write_block(rom_num * 8, metadata);
 }
 
+const CHIP8_HOOKS emu_hooks = {.clock = emu_clock, .save = emu_save};
+
 // Set up the emulator to begin running.
 bool init_emulator(void) {
-    chip8_init(&chip8, cpu_freq, timer_freq, refresh_freq, PC_START_ADDR_DEFAULT,
-               quirks, metadata, rom_num);
+    frame_sliced = rom_meta.frame_sliced;
+    chip8_init(&chip8, rom_meta.cpu_freq, rom_meta.timer_freq, rom_meta.refresh_freq,
+               PC_START_ADDR_DEFAULT, rom_meta.quirks, metadata, rom_num, &emu_hooks);
     chip8_load_font(&chip8);
 
     return true;
 }
 
-void load_rom(int rom_num) {
-    uint32_t start_sector = rom_num * 8;
+// Loads a ROM and its metadata. Returns false if the slot is empty.
+bool load_rom(int rom_num) {
+    uint32_t start_sector = rom_num * CARTRIDGE_SLOT_BLOCKS;
     sd_read_block(start_sector, metadata);
-    sd_read_blocks(start_sector + 1, chip8.RAM + PC_START_ADDR_DEFAULT, 7);
+
+    if (!cartridge_parse(metadata, &rom_meta))
+        return false;
+
+    // The ROM stops where an input recording starts.
+    int rom_blocks = rom_meta.replay_block ? rom_meta.replay_block - 1 : CARTRIDGE_ROM_BLOCKS;
+    uint8_t *rom = chip8.RAM + PC_START_ADDR_DEFAULT;
+
+    sd_read_blocks(start_sector + 1, rom, rom_blocks);
+    memset(rom + (rom_blocks * SD_BLOCK_SIZE), 0, (CARTRIDGE_ROM_BLOCKS - rom_blocks) * SD_BLOCK_SIZE);
+    chip8_invalidate(&chip8, PC_START_ADDR_DEFAULT, CARTRIDGE_ROM_BLOCKS * SD_BLOCK_SIZE);
+
+    return true;
+}
+
+bool replay_read(void *ctx, uint32_t block, uint8_t *data) {
+    (void)ctx;
+    return sd_read_block((rom_num * CARTRIDGE_SLOT_BLOCKS) + rom_meta.replay_block + block, data);
 }
 
-bool process_metadata(void) {
-    if (metadata[0] == 0xC8) {
-        strcpy(title, (char *)(&metadata[1]));
+bool replay_write(void *ctx, uint32_t block, const uint8_t *data) {
+    (void)ctx;
+    return sd_write_block((rom_num * CARTRIDGE_SLOT_BLOCKS) + rom_meta.replay_block + block, data);
+}
+
+// The input recording in the spare blocks of the ROM's slot.
+REPLAY_STORE replay_store(void) {
+    REPLAY_STORE store = {replay_read, replay_write, NULL, 0};
 
-        cpu_freq = (metadata[12] << 24) | (metadata[13] << 16) | (metadata[14] << 8) | (metadata[15]);
-        timer_freq = metadata[16];
-        refresh_freq = metadata[17];
+    if (rom_meta.replay_block)
+        store.num_blocks = CARTRIDGE_SLOT_BLOCKS - rom_meta.replay_block;
 
-        parse_quirks(metadata[18]);
+    return store;
+}
 
-        BTN_LEFT_MAP = (metadata[19] << 8) | (metadata[20]);
-        BTN_RIGHT_MAP = (metadata[21] << 8) | (metadata[22]);
-        BTN_UP_MAP = (metadata[23] << 8) | (metadata[24]);
-        BTN_DOWN_MAP = (metadata[25] << 8) | (metadata[26]);
-        BTN_A_MAP = (metadata[27] << 8) | (metadata[28]);
-        BTN_B_MAP = (metadata[29] << 8) | (metadata[30]);
+// Records input into the blocks after the ROM, if the slot has any left.
+bool start_recording(void) {
+    if (!rom_meta.replay_block) {
+        uint8_t first = 1 + cartridge_rom_blocks(chip8.RAM + PC_START_ADDR_DEFAULT,
+                                                 CARTRIDGE_ROM_BLOCKS * SD_BLOCK_SIZE);
+        if (first >= CARTRIDGE_SLOT_BLOCKS)
+            return false;
 
-        return true;
+        cartridge_set_replay_block(metadata, &rom_meta, first);
+        sd_write_block(rom_num * CARTRIDGE_SLOT_BLOCKS, metadata);
     }
 
-    return false;
+    REPLAY_STORE store = replay_store();
+    return replay_record(&replay, &store, &chip8);
 }
 
 // Very slow... but functional for now
 bool seek_rom(int dir) {
     int attempts = 0;
+    bool found;
 
     do {
         if (rom_num >= MAX_ROMS)
@@ -116,11 +207,11 @@ bool seek_rom(int dir) {
         else if (rom_num < 0)
             rom_num = MAX_ROMS - 1;
 
-        load_rom(rom_num);
+        found = load_rom(rom_num);
         rom_num += dir;
 
         attempts++;
-    } while (attempts <= MAX_ROMS && !process_metadata());
+    } while (attempts <= MAX_ROMS && !found);
 
     if (attempts <= MAX_ROMS) {
         rom_num -= dir;
@@ -131,33 +222,43 @@ bool seek_rom(int dir) {
     return false;
 }
 
-void select_rom(void) {
+/* Lets the user pick a ROM, and whether to play it (A), record the input while
+playing (B) or replay the recording (up). */
+REPLAY_MODE select_rom(void) {
     int scan_dir = 1;
     bool rom_exists = seek_rom(scan_dir);
 
     while (rom_exists) {
+        REPLAY_STORE store = replay_store();
+        bool has_replay = replay_exists(&store);
+        REPLAY_MODE mode = REPLAY_OFF;
+
         display_clear();
-        display_print(36 + ((10 - strlen(title)) * 2), 3, title);
+        display_print(36 + ((10 - strlen(rom_meta.title)) * 2), 3, rom_meta.title);
         display_print(2, 4, "<                   >");
         display_print(19, 5, "PRESS A TO PLAY");
+        display_print(has_replay ? 13 : 31, 6, has_replay ? "B REC   UP REPLAY" : "B TO RECORD");
 
         scan_dir = 0;
         while (!scan_dir) {
-            if (btn_released(BTN_A)) {
-                pwm_start();
-                delay(500);
-                pwm_stop();
-                return;
+            if (btn_released(BTN_UP) && has_replay)
+                mode = REPLAY_PLAY;
+            else if (btn_released(BTN_B))
+                mode = REPLAY_RECORD;
+
+            if (mode != REPLAY_OFF || btn_released(BTN_A)) {
+                beep(500);
+                return mode;
             } else if (btn_released(BTN_RIGHT))
                 scan_dir = 1;
             else if (btn_released(BTN_LEFT))
                 scan_dir = -1;
+            else
+                idle_until(IDLE_FOREVER);  // Until a button changes
         }
         rom_num += scan_dir;
 
-        pwm_start();
-        delay(1);
-        pwm_stop();
+        beep(1);
 
         rom_exists = seek_rom(scan_dir);
     }
@@ -172,54 +273,229 @@ void select_rom(void) {
 
 // Makes the physical screen match the emulator display.
 void draw_display(void) {
-    display_draw(chip8.display);
+    chip8_present(&chip8);
+
+#if CHIP8_PAGE_MAJOR
+    display_draw_pages(chip8.display, chip8.display_dirty);
+#else
+    display_draw(chip8.display, chip8.display_dirty);
+#endif
 }
 
 // Handles sound.
-void handle_sound(void) {
-    if (!play_sound && chip8.beep) {
+void set_sound(bool on) {
+    if (!play_sound && on) {
         pwm_start();
         play_sound = true;
-    } else if (play_sound && !chip8.beep) {
+    } else if (play_sound && !on) {
         pwm_stop();
         play_sound = false;
     }
 }
 
+/* Fx18 changes beep between ticks, so it is followed here too. The timer
+interrupt may change it meanwhile (and set the buzzer itself), so it is
+checked again to end up where the interrupt left it. */
+void handle_sound(void) {
+    bool on = chip8.beep;
+
+    set_sound(on);
+    if (timer_interrupt && chip8.beep != on)
+        set_sound(chip8.beep);
+}
+
+// Counts the timers down and starts/stops the buzzer on the same tick.
+void tick_timers(void) {
+    chip8_tick_timers(&chip8);
+    set_sound(chip8.beep);
+    idle_wake();
+}
+
+/* Ticks the timers from a timer interrupt, except in lockstep where they have
+to follow the emulated time, and on the frame-sliced scheduler which ticks
+them once a frame. */
+void start_timers(void) {
+    timer_interrupt = !lockstep && !frame_sliced && chip8.timer_freq >= TICKER_MIN_FREQ;
+
+    ticker_stop();
+    chip8_set_timer_ticks(&chip8, timer_interrupt || frame_sliced);
+    if (timer_interrupt)
+        ticker_start(chip8.timer_freq, tick_timers);
+
+    frames_start = lockstep ? 0 : clock_us();
+    frame_num = 0;
+}
+
+/* Whether the next frame of the frame-sliced scheduler is due. Frames start at
+exact multiples of the frame period, but one that is more than a frame late
+(such as after a save) starts the count over rather than rushing to catch up. */
+bool frame_due(void) {
+    uint32_t freq = chip8.timer_freq ? chip8.timer_freq : TIMER_FREQ_DEFAULT;
+    uint64_t now = lockstep ? (uint64_t)emu_ms * 1000 : clock_us();
+
+    // Both sides scaled by freq, so no division is needed
+    uint64_t scaled = (now - frames_start) * freq;
+    uint64_t due = (uint64_t)frame_num * 1000000;
+
+    if (scaled < due)
+        return false;
+
+    if (scaled - due > 1000000) {
+        frames_start = now;
+        frame_num = 0;
+    }
+
+    frame_num++;
+    return true;
+}
+
+// When the next frame of the frame-sliced scheduler is due.
+uint64_t next_frame_us(void) {
+    uint32_t freq = chip8.timer_freq ? chip8.timer_freq : TIMER_FREQ_DEFAULT;
+    return frames_start + ((((uint64_t)frame_num * 1000000) + freq - 1) / freq);
+}
+
 // Handles drawing the display.
 void handle_display(void) {
     if (chip8.display_updated) {
         draw_display();
+        frameprof_end_frame();
+    }
+}
+
+// Whether all the buttons of a chord have just become held.
+bool chord_pressed(uint8_t held, uint8_t chord) {
+    return (held & chord) == chord && (held_btns & chord) != chord;
+}
+
+// Starts running the emulator, recording or replaying if asked to.
+void start_emulator(REPLAY_MODE mode) {
+    lockstep = mode != REPLAY_OFF;
+    emu_ms = 0;
+    init_emulator();
+
+    if (mode == REPLAY_RECORD) {
+        lockstep = start_recording();
+    } else if (mode == REPLAY_PLAY) {
+        REPLAY_STORE store = replay_store();
+        lockstep = replay_play(&replay, &store, &chip8);
+    }
+
+    // Couldn't record or replay, so just play on the real clock.
+    if (mode != REPLAY_OFF && !lockstep)
+        init_emulator();
+
+    start_timers();
+    lockstep_start = clock_get();
+}
+
+// Shows what went wrong over the game for a moment, then redraws the game.
+void show_save_error(const char *msg) {
+    display_clear();
+    display_print(64 - (strlen(msg) * 3), 4, msg);
+    delay(SAVE_ERROR_MS);
+
+    chip8_mark_display_dirty(&chip8);
+    chip8.display_updated = true;
+}
+
+// Saves or loads the game, unless a recording is running or being replayed.
+void handle_save_state(uint8_t held) {
+    if (replay.mode != REPLAY_OFF)
+        return;
+
+    uint32_t addr = CARTRIDGE_SAVES_START + (rom_num * SAVESTATE_BLOCKS);
+
+    if (chord_pressed(held, SAVE_CHORD)) {
+        if (!savestate_save(&chip8, addr))
+            show_save_error("SAVE FAILED");
+    } else if (chord_pressed(held, LOAD_CHORD)) {
+        SAVESTATE_RESULT result = savestate_load(&chip8, addr);
+
+        if (result == SAVESTATE_NONE) {
+            show_save_error("NO SAVE");
+        } else if (result == SAVESTATE_BROKEN) {
+            // A half loaded machine can't carry on, so start the ROM over
+            show_save_error("LOAD FAILED");
+            load_rom(rom_num);
+            start_emulator(REPLAY_OFF);
+        }
     }
 }
 
-// Checks for key presses/releases and a quit event.
+// Passes button presses/releases on to the emulator (or the recording).
 void handle_input(void) {
-    if (btn_pressed(BTN_LEFT))
-        btn_to_key(BTN_LEFT_MAP, KEY_DOWN);
-    if (btn_pressed(BTN_UP))
-        btn_to_key(BTN_UP_MAP, KEY_DOWN);
-    if (btn_pressed(BTN_DOWN))
-        btn_to_key(BTN_DOWN_MAP, KEY_DOWN);
-    if (btn_pressed(BTN_RIGHT))
-        btn_to_key(BTN_RIGHT_MAP, KEY_DOWN);
-    if (btn_pressed(BTN_A))
-        btn_to_key(BTN_A_MAP, KEY_DOWN);
-    if (btn_pressed(BTN_B))
-        btn_to_key(BTN_B_MAP, KEY_DOWN);
-
-    if (btn_released(BTN_LEFT))
-        btn_to_key(BTN_LEFT_MAP, KEY_RELEASED);
-    if (btn_released(BTN_UP))
-        btn_to_key(BTN_UP_MAP, KEY_RELEASED);
-    if (btn_released(BTN_DOWN))
-        btn_to_key(BTN_DOWN_MAP, KEY_RELEASED);
-    if (btn_released(BTN_RIGHT))
-        btn_to_key(BTN_RIGHT_MAP, KEY_RELEASED);
-    if (btn_released(BTN_A))
-        btn_to_key(BTN_A_MAP, KEY_RELEASED);
-    if (btn_released(BTN_B))
-        btn_to_key(BTN_B_MAP, KEY_RELEASED);
+    uint8_t held = btn_pressed_mask();
+    uint8_t released = btn_released_mask();
+
+    handle_save_state(held);
+
+    // A button let go of before it was seen held still counts as pressed.
+    uint8_t pressed = (held | released) & ~held_btns;
+    held_btns = held;
+
+    replay_input(&replay, &chip8, cartridge_btns_to_keys(&rom_meta, pressed),
+                 cartridge_btns_to_keys(&rom_meta, released));
+}
+
+/* Answers requests over UART: 'i' for how long the CPU has slept, anything
+else for the instruction profile (with CHIP8_PROFILE). Requests are dropped
+with FRAME_PROFILE, as text would land in the middle of its records. */
+void handle_uart(void) {
+    if (uart_rx_empty())
+        return;
+
+    uint8_t request = uart_read();
+#if FRAME_PROFILE
+    (void)request;
+    return;
+#endif
+
+    if (request == 'i') {
+        unsigned long total_ms = clock_us() / 1000;
+        unsigned long idle_ms = idle_us() / 1000;
+        char msg[96];
+
+        sprintf(msg, "idle %lu ms, busy %lu ms (%lu%% idle)\n", idle_ms, total_ms - idle_ms,
+                total_ms ? (idle_ms * 100) / total_ms : 0);
+        uart_write_str(msg);
+    }
+#if CHIP8_PROFILE
+    else {
+        chip8_profile_dump(&chip8, uart_write_str);
+    }
+#endif
+}
+
+/* The clock_us() at which clock_get() is ms on from start, or 0 if it already
+is. Only the time still to go is taken from the ms clock, so this keeps
+working once it wraps (after 49.7 days). */
+uint64_t ms_deadline(uint32_t start, uint32_t ms) {
+    uint64_t now_ms = clock_us() / 1000;
+    uint32_t elapsed = (uint32_t)now_ms - start;
+
+    return elapsed >= ms ? 0 : (now_ms + (ms - elapsed)) * 1000;
+}
+
+// Sleeps until the emulator next has something to do, or an interrupt.
+void sleep_until_due(void) {
+    uint64_t deadline;
+
+    if (lockstep) {
+        // The next emulated ms
+        deadline = ms_deadline(lockstep_start, emu_ms + 1);
+    } else if (frame_sliced) {
+        deadline = next_frame_us();
+    } else {
+        uint32_t ms = chip8_next_cycle_ms(&chip8);
+        deadline = ms ? ms_deadline(chip8.cur_cycle_start, ms) : 0;
+    }
+
+    if (!deadline)
+        return;
+
+    frameprof_phase(FRAME_IDLE);
+    idle_until(deadline);
 }
 
 void echo_sd_read(uint32_t addr) {
@@ -244,7 +520,7 @@ void handle_sd() {
     if (!sd_inserted()) {
         display_print(2, 4, "INSERT GAME CARTRIDGE");
         while (!sd_inserted())
-            ;
+            idle_until(clock_us() + SD_POLL_US);
 
         // Wait briefly for SD to be fully inserted
         display_clear();
@@ -256,7 +532,7 @@ void handle_sd() {
         display_print(5, 3, "GAME CARTRIDGE ERROR");
         display_print(22, 4, "PLEASE RESTART");
         while (1)
-            ;
+            idle_until(IDLE_FOREVER);
     }
 }
 
@@ -267,29 +543,68 @@ int main(void) {
     gpio_init(GPIOB);
     led_enable();
 
+    // Started first, as everything from here on sleeps on them
+    clock_start();
+    swtimer_init();
+
     pwm_init(880);
 
     display_init();
     show_splash();
 
-    handle_sd();
+    // Bring the cartridge up while the splash screen beeps
+    bool sd_ready = sd_inserted() && sd_init();
+    end_splash();
+    if (!sd_ready)
+        handle_sd();
 
     buttons_init();
 
-    clock_start();
+    uart_init(115200);
+    uart_en_rx_int();
 
-    select_rom();
-    init_emulator();
+    start_emulator(select_rom());
+    frameprof_init();
 
     while (1) {
+        if (lockstep) {
+            if (emu_ms == clock_get() - lockstep_start) {
+                sleep_until_due();
+                continue;
+            }
+            emu_ms++;
+        }
+
+        // Sleep through the rest of the frame
+        if (frame_sliced && !frame_due()) {
+            sleep_until_due();
+            continue;
+        }
+
+        frameprof_phase(FRAME_INPUT);
         handle_input();
-        chip8_cycle(&chip8);
+        frameprof_phase(FRAME_CPU);
+        if (frame_sliced)
+            chip8_frame(&chip8);
+        else
+            chip8_cycle(&chip8);
+        frameprof_phase(FRAME_SOUND);
         handle_sound();
+        frameprof_phase(FRAME_DISPLAY);
         handle_display();
+        handle_uart();
 
         // Exit gets set true if the ROM calls the exit command
-        if (chip8.exit)
+        if (chip8.exit) {
+            replay_stop(&replay);
+            lockstep = false;
             chip8_reset(&chip8);
+            start_timers();
+        }
+
+        // Frames and lockstep only sleep once the next is checked for above
+        if (!lockstep && !frame_sliced)
+            sleep_until_due();
     }
 
     return 0;
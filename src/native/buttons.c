@@ -0,0 +1,188 @@
+#include "buttons.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "idle.h"
+
+#define HOLD_MS 100  // How long a key press holds its button down
+
+// Bit per button (see BTN_*_BIT): held down, and released but not yet read.
+static uint8_t down_mask = 0;
+static uint8_t released_mask = 0;
+static uint32_t press_time[NUM_BUTTONS] = {0};
+static struct termios saved_term;
+
+/* Keys are read by a thread standing in for the button interrupts, so it can
+wake the emulator as they are pressed and released. */
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Maps a key read from stdin to a button index (same order as the firmware).
+static int _key_to_idx(char c) {
+    switch (c) {
+    case 'a':
+        return 0;
+    case 'd':
+        return 1;
+    case 'w':
+        return 2;
+    case 's':
+        return 3;
+    case 'k':
+        return 4;
+    case 'j':
+        return 5;
+    }
+
+    return -1;
+}
+
+static int _get_btn_idx(enum Button btn) {
+    switch (btn) {
+    case BTN_LEFT:
+        return 0;
+    case BTN_RIGHT:
+        return 1;
+    case BTN_UP:
+        return 2;
+    case BTN_DOWN:
+        return 3;
+    case BTN_A:
+        return 4;
+    case BTN_B:
+        return 5;
+    }
+
+    return 0;
+}
+
+static void _press(int idx) {
+    down_mask |= (1 << idx);
+    released_mask &= ~(1 << idx);
+}
+
+static void _release(int idx) {
+    if (down_mask & (1 << idx)) {
+        down_mask &= ~(1 << idx);
+        released_mask |= (1 << idx);
+    }
+}
+
+// Presses buttons for keys waiting on stdin. Returns false once stdin is closed.
+static bool _read_keys(void) {
+    uint32_t now = clock_get();
+    ssize_t n;
+    char c;
+
+    while ((n = read(STDIN_FILENO, &c, 1)) == 1) {
+        int idx = _key_to_idx(c);
+
+        if (idx >= 0) {
+            _press(idx);
+            press_time[idx] = now;
+        }
+    }
+
+    return n != 0;
+}
+
+// Releases buttons held long enough. Returns ms until the next is due, or -1.
+static int _release_held(void) {
+    uint32_t now = clock_get();
+    int next = -1;
+
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        if (!(down_mask & (1 << i))) {
+            continue;
+        }
+
+        uint32_t held = now - press_time[i];
+        if (held >= HOLD_MS) {
+            _release(i);
+        } else if (next < 0 || (int)(HOLD_MS - held) < next) {
+            next = HOLD_MS - held;
+        }
+    }
+
+    return next;
+}
+
+static void *_watch(void *arg) {
+    (void)arg;
+    struct pollfd stdin_poll = {STDIN_FILENO, POLLIN, 0};
+    int timeout = -1;
+
+    while (true) {
+        int ready = poll(&stdin_poll, 1, timeout);
+
+        pthread_mutex_lock(&lock);
+        if (ready > 0 && !_read_keys()) {
+            stdin_poll.fd = -1;  // Closed, so only releases are left to wait for
+        }
+        timeout = _release_held();
+        pthread_mutex_unlock(&lock);
+
+        idle_wake();
+    }
+
+    return NULL;
+}
+
+static void _restore_term(void) {
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved_term);
+}
+
+void buttons_init(void) {
+    // Read keys as they are typed, without echo
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved_term) == 0) {
+        struct termios raw = saved_term;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        atexit(_restore_term);
+    }
+
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    pthread_create(&thread, NULL, _watch, NULL);
+}
+
+bool btn_pressed(enum Button btn) {
+    pthread_mutex_lock(&lock);
+    bool pressed = down_mask & (1 << _get_btn_idx(btn));
+    pthread_mutex_unlock(&lock);
+
+    return pressed;
+}
+
+bool btn_released(enum Button btn) {
+    uint8_t bit = 1 << _get_btn_idx(btn);
+
+    pthread_mutex_lock(&lock);
+    bool released = released_mask & bit;
+    released_mask &= ~bit;
+    pthread_mutex_unlock(&lock);
+
+    return released;
+}
+
+uint8_t btn_pressed_mask(void) {
+    pthread_mutex_lock(&lock);
+    uint8_t pressed = down_mask;
+    pthread_mutex_unlock(&lock);
+
+    return pressed;
+}
+
+uint8_t btn_released_mask(void) {
+    pthread_mutex_lock(&lock);
+    uint8_t released = released_mask;
+    released_mask = 0;
+    pthread_mutex_unlock(&lock);
+
+    return released;
+}
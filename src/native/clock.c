@@ -0,0 +1,45 @@
+#include "clock.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "native.h"
+
+static uint64_t start_us = 0;
+static uint32_t run_ms = 0;
+static pthread_t power_thread;
+
+static uint64_t _now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+// Powers off after run_ms, even while the firmware sleeps.
+static void *_power_off(void *arg) {
+    (void)arg;
+    struct timespec ts = {run_ms / 1000, (run_ms % 1000) * 1000000L};
+
+    while (nanosleep(&ts, &ts))
+        ;
+    exit(0);
+}
+
+void clock_start(void) {
+    start_us = _now_us();
+    run_ms = strtoul(native_env("CHIPNGO_RUN_MS", "0"), NULL, 10);
+
+    if (run_ms) {
+        pthread_create(&power_thread, NULL, _power_off, NULL);
+    }
+}
+
+uint64_t clock_us(void) {
+    return _now_us() - start_us;
+}
+
+uint32_t clock_get(void) {
+    return clock_us() / 1000;
+}
@@ -0,0 +1,17 @@
+#include "cycles.h"
+
+#include <time.h>
+
+void cycles_init(void) {
+}
+
+uint32_t cycles_get(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+uint32_t cycles_to_us(uint32_t cycles) {
+    return cycles / 1000;
+}
@@ -0,0 +1,34 @@
+#include "gpio.h"
+
+#include "native.h"
+
+#define SD_DET_PIN 9  // A9
+
+// Output state of every pin.
+static uint16_t odr[GPIOG + 1];
+
+void gpio_init(GPIO port) {
+    (void)port;
+}
+
+void gpio_set_mode(GPIO port, int pin, GPIO_MODE mode) {
+    if (mode == GPIO_IN_PULLUP) {
+        gpio_write(port, pin, true);
+    }
+}
+
+void gpio_write(GPIO port, int pin, bool on) {
+    if (on) {
+        odr[port] |= (1 << pin);
+    } else {
+        odr[port] &= ~(1 << pin);
+    }
+}
+
+bool gpio_read(GPIO port, int pin) {
+    if (port == GPIOA && pin == SD_DET_PIN) {
+        return sd_card_inserted();
+    }
+
+    return odr[port] & (1 << pin);
+}
@@ -0,0 +1,71 @@
+#include "idle.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "clock.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake;
+static pthread_once_t wake_once = PTHREAD_ONCE_INIT;
+static bool wake_pending = false;
+static uint64_t slept_us = 0;
+
+// The condition variable waits on the same clock as clock_us().
+static void _init_wake(void) {
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wake, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void idle_until(uint64_t deadline) {
+    uint64_t start = clock_us();
+
+    pthread_once(&wake_once, _init_wake);
+    pthread_mutex_lock(&lock);
+
+    while (!wake_pending) {
+        uint64_t now = clock_us();
+        if (now >= deadline) {
+            break;
+        }
+
+        if (deadline == IDLE_FOREVER) {
+            pthread_cond_wait(&wake, &lock);
+        } else {
+            struct timespec ts;
+            uint64_t wait_us = deadline - now;
+
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_sec += wait_us / 1000000;
+            ts.tv_nsec += (wait_us % 1000000) * 1000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_nsec -= 1000000000;
+                ts.tv_sec++;
+            }
+
+            pthread_cond_timedwait(&wake, &lock, &ts);
+        }
+    }
+
+    wake_pending = false;
+    pthread_mutex_unlock(&lock);
+
+    slept_us += clock_us() - start;
+}
+
+void idle_wake(void) {
+    pthread_once(&wake_once, _init_wake);
+    pthread_mutex_lock(&lock);
+    wake_pending = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+uint64_t idle_us(void) {
+    return slept_us;
+}
@@ -0,0 +1,13 @@
+#include "led.h"
+
+void led_enable(void) {
+}
+
+void led_on(void) {
+}
+
+void led_off(void) {
+}
+
+void led_toggle(void) {
+}
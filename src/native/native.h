@@ -0,0 +1,28 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+/* Models of the hardware on the board, used by the native (Linux) build in
+place of the real peripherals.
+
+Configured through environment variables:
+    CHIPNGO_SD      Image of the game cartridge (default cartridge.img).
+    CHIPNGO_LCD     Where the LCD is dumped as a PBM on exit (default lcd.pbm).
+    CHIPNGO_RUN_MS  Power off after this many ms (default: run until killed).
+
+Buttons are read from stdin: w/a/s/d for the directions, k for A, j for B. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Returns the value of an environment variable, or def if it isn't set.
+const char *native_env(const char *name, const char *def);
+
+// SD card on SPI1.
+bool sd_card_inserted(void);
+uint8_t sd_card_transfer(uint8_t data);
+
+// ST7567 LCD on SPI2. a0 is the state of the data/command pin.
+void st7567_write(uint8_t data, bool a0);
+void st7567_dump(void);
+
+#endif
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "native.h"
+#include "sd.h"
+
+/* An SDHC card in SPI mode, just enough of one for the firmware's driver.
+Blocks are read from and written to an image file. */
+
+#define CMD_LEN 6
+#define START_TOKEN 0xFE
+#define MULTI_START_TOKEN 0xFC
+#define STOP_TOKEN 0xFD
+#define DATA_ACCEPTED 0x05
+
+#define R1_IDLE 0x01
+#define R1_OK 0x00
+
+typedef enum {
+    CARD_CMD,       // Waiting for a command
+    CARD_WRITE,     // Waiting for the start token of a block to write
+    CARD_WRITE_DATA // Receiving a block (and its CRC)
+} CARD_STATE;
+
+static FILE *image = NULL;
+static bool opened = false;
+static bool idle = true;
+static CARD_STATE state = CARD_CMD;
+
+// Command being received.
+static uint8_t cmd[CMD_LEN];
+static int cmd_len = 0;
+
+// Block being written.
+static uint8_t block[SD_BLOCK_SIZE + 2];
+static int block_len = 0;
+static uint32_t block_addr = 0;
+
+// Writing multiple blocks, until the stop token.
+static bool multi_write = false;
+
+// Next block to send while reading multiple blocks.
+static bool streaming = false;
+static uint32_t stream_addr = 0;
+
+// Bytes queued to send back, one per transfer.
+static uint8_t out[SD_BLOCK_SIZE + 16];
+static int out_head = 0;
+static int out_len = 0;
+
+static FILE *_image(void) {
+    if (!opened) {
+        const char *path = native_env("CHIPNGO_SD", "cartridge.img");
+
+        image = fopen(path, "r+b");
+        if (!image) {
+            image = fopen(path, "rb");
+        }
+
+        opened = true;
+    }
+
+    return image;
+}
+
+static void _queue(const uint8_t *data, int len) {
+    if (out_head == out_len) {
+        out_head = out_len = 0;
+    }
+
+    memcpy(&out[out_len], data, len);
+    out_len += len;
+}
+
+static void _queue_byte(uint8_t data) {
+    _queue(&data, 1);
+}
+
+// Queues a data packet with the contents of a block (zeros past the image end).
+static void _queue_block(uint32_t addr) {
+    uint8_t data[SD_BLOCK_SIZE] = {0};
+
+    if (_image() && fseek(image, (long)addr * SD_BLOCK_SIZE, SEEK_SET) == 0) {
+        size_t n = fread(data, 1, SD_BLOCK_SIZE, image);
+        (void)n;
+    }
+
+    _queue_byte(0xFF);
+    _queue_byte(START_TOKEN);
+    _queue(data, SD_BLOCK_SIZE);
+    _queue_byte(0xFF);  // CRC
+    _queue_byte(0xFF);
+}
+
+static void _write_block(void) {
+    if (_image() && fseek(image, (long)block_addr * SD_BLOCK_SIZE, SEEK_SET) == 0) {
+        fwrite(block, 1, SD_BLOCK_SIZE, image);
+        fflush(image);
+    }
+}
+
+static void _command(void) {
+    uint8_t index = cmd[0] & 0x3F;
+    uint32_t arg = (cmd[1] << 24) | (cmd[2] << 16) | (cmd[3] << 8) | cmd[4];
+
+    // A new command (STOP_TRANSMISSION included) ends any block stream
+    streaming = false;
+    out_head = out_len = 0;
+
+    _queue_byte(0xFF);  // Response time
+
+    switch (index) {
+    case 0:  // GO_IDLE_STATE
+        idle = true;
+        _queue_byte(R1_IDLE);
+        break;
+    case 8:  // SEND_IF_COND
+        _queue((const uint8_t[]){R1_IDLE, 0x00, 0x00, 0x01, 0xAA}, 5);
+        break;
+    case 55:  // APP_CMD
+        _queue_byte(idle ? R1_IDLE : R1_OK);
+        break;
+    case 41:  // SD_SEND_OP_COND (ready straight away)
+        idle = false;
+        _queue_byte(R1_OK);
+        break;
+    case 58:  // READ_OCR (powered up, CCS set)
+        _queue((const uint8_t[]){R1_OK, 0xC0, 0xFF, 0x80, 0x00}, 5);
+        break;
+    case 12:  // STOP_TRANSMISSION (after a stuff byte)
+        _queue_byte(0xFF);
+        _queue_byte(R1_OK);
+        break;
+    case 17:  // READ_SINGLE_BLOCK
+        _queue_byte(R1_OK);
+        _queue_block(arg);
+        break;
+    case 18:  // READ_MULTIPLE_BLOCK
+        _queue_byte(R1_OK);
+        streaming = true;
+        stream_addr = arg;
+        break;
+    case 24:  // WRITE_BLOCK
+    case 25:  // WRITE_MULTIPLE_BLOCK
+        _queue_byte(R1_OK);
+        block_addr = arg;
+        multi_write = index == 25;
+        state = CARD_WRITE;
+        break;
+    default:
+        _queue_byte(0x04);  // Illegal command
+        break;
+    }
+}
+
+bool sd_card_inserted(void) {
+    return _image() != NULL;
+}
+
+uint8_t sd_card_transfer(uint8_t data) {
+    // Send whatever is queued while receiving
+    if (out_head == out_len && streaming) {
+        _queue_block(stream_addr++);
+    }
+
+    uint8_t resp = (out_head < out_len) ? out[out_head++] : 0xFF;
+
+    switch (state) {
+    case CARD_CMD:
+        // Commands start with 01 in the top bits, anything else is filler
+        if (cmd_len > 0 || (data & 0xC0) == 0x40) {
+            cmd[cmd_len++] = data;
+
+            if (cmd_len == CMD_LEN) {
+                cmd_len = 0;
+                _command();
+            }
+        }
+        break;
+    case CARD_WRITE:
+        if (data == (multi_write ? MULTI_START_TOKEN : START_TOKEN)) {
+            block_len = 0;
+            state = CARD_WRITE_DATA;
+        } else if (multi_write && data == STOP_TOKEN) {
+            _queue((const uint8_t[]){0xFF, 0x00}, 2);  // Stuff byte, then busy
+            state = CARD_CMD;
+        }
+        break;
+    case CARD_WRITE_DATA:
+        block[block_len++] = data;
+
+        if (block_len == sizeof(block)) {
+            _write_block();
+            _queue_byte(DATA_ACCEPTED);
+
+            // Busy for a byte while programming, then ready for the next block
+            if (multi_write) {
+                _queue_byte(0x00);
+                block_addr++;
+                state = CARD_WRITE;
+            } else {
+                state = CARD_CMD;
+            }
+        }
+        break;
+    }
+
+    return resp;
+}
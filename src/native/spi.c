@@ -0,0 +1,27 @@
+#include "spi.h"
+
+#include "gpio.h"
+#include "native.h"
+
+#define LCD_A0_PIN 8  // A8
+
+// Byte received during the last write on each bus.
+static uint8_t dr[SPI2 + 1];
+
+void spi_init(SPI spi, SPI_DIV div, int flags) {
+    (void)spi;
+    (void)div;
+    (void)flags;
+}
+
+void spi_write(SPI spi, uint8_t data) {
+    if (spi == SPI1) {
+        dr[spi] = sd_card_transfer(data);
+    } else {
+        st7567_write(data, gpio_read(GPIOA, LCD_A0_PIN));
+    }
+}
+
+uint8_t spi_read(SPI spi) {
+    return dr[spi];
+}
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "native.h"
+
+#define SET_PAGE_ADDR 0xB0
+#define SET_COL_ADDR_MSB 0x10
+#define SET_COL_ADDR_LSB 0x00
+
+#define NUM_COLS 128
+#define NUM_PAGES 8
+
+// Display RAM, in the controller's own page order (bit 0 topmost).
+static uint8_t ram[NUM_PAGES][NUM_COLS];
+static int page = 0;
+static int col = 0;
+
+void st7567_write(uint8_t data, bool a0) {
+    if (a0) {
+        // Data goes to the current column, which then advances
+        if (col < NUM_COLS) {
+            ram[page][col++] = data;
+        }
+    } else if ((data & 0xF0) == SET_PAGE_ADDR) {
+        page = data & 0x07;
+    } else if ((data & 0xF0) == SET_COL_ADDR_MSB) {
+        col = ((data & 0x0F) << 4) | (col & 0x0F);
+    } else if ((data & 0xF0) == SET_COL_ADDR_LSB) {
+        col = (col & 0xF0) | (data & 0x0F);
+    }
+
+    // Everything else is power/contrast setup with nothing to model
+}
+
+void st7567_dump(void) {
+    FILE *f = fopen(native_env("CHIPNGO_LCD", "lcd.pbm"), "wb");
+    if (!f) {
+        return;
+    }
+
+    fprintf(f, "P4\n%d %d\n", NUM_COLS, NUM_PAGES * 8);
+
+    for (int y = 0; y < NUM_PAGES * 8; y++) {
+        uint8_t row[NUM_COLS / 8];
+        memset(row, 0, sizeof(row));
+
+        for (int x = 0; x < NUM_COLS; x++) {
+            if (ram[y / 8][x] & (1 << (y % 8))) {
+                row[x / 8] |= (0x80 >> (x % 8));
+            }
+        }
+
+        fwrite(row, 1, sizeof(row), f);
+    }
+
+    fclose(f);
+}
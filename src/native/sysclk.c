@@ -0,0 +1,38 @@
+#include "sysclk.h"
+
+#include <signal.h>
+#include <stdlib.h>
+
+#include "native.h"
+
+#define MHz 1000000
+
+long CLOCK_SPEED = 8 * MHz;
+long APB1_CLOCK_SPEED = 8 * MHz;
+long APB2_CLOCK_SPEED = 8 * MHz;
+long ADC_CLOCK_SPEED = 8 * MHz;
+long AHB_CLOCK_SPEED = 8 * MHz;
+
+const char *native_env(const char *name, const char *def) {
+    const char *value = getenv(name);
+    return value ? value : def;
+}
+
+// Powers off cleanly so the LCD gets dumped and profilers get their data.
+static void _power_off(int sig) {
+    (void)sig;
+    exit(0);
+}
+
+void set_sysclk(int mhz) {
+    // Same clock tree as the real board, so drivers compute the same values
+    CLOCK_SPEED = mhz * MHz;
+    APB1_CLOCK_SPEED = (mhz > 36) ? (mhz / 2) * MHz : mhz * MHz;
+    APB2_CLOCK_SPEED = CLOCK_SPEED;
+    ADC_CLOCK_SPEED = CLOCK_SPEED;
+    AHB_CLOCK_SPEED = CLOCK_SPEED;
+
+    signal(SIGINT, _power_off);
+    signal(SIGTERM, _power_off);
+    atexit(st7567_dump);
+}
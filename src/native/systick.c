@@ -0,0 +1,53 @@
+#include <pthread.h>
+#include <time.h>
+
+#include "swtimer.h"
+
+#define NS_PER_TICK (1000000000L / SWTIMER_TICKS_PER_SEC)
+
+// SysTick is a thread that wakes every ms, and the lock a recursive mutex.
+static pthread_t thread;
+static pthread_mutex_t lock;
+static pthread_once_t lock_once = PTHREAD_ONCE_INIT;
+
+static void _init_lock(void) {
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static void *_run(void *arg) {
+    (void)arg;
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (1) {
+        next.tv_nsec += NS_PER_TICK;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        swtimer_tick();
+    }
+
+    return NULL;
+}
+
+void swtimer_init(void) {
+    pthread_create(&thread, NULL, _run, NULL);
+}
+
+void swtimer_lock(void) {
+    pthread_once(&lock_once, _init_lock);
+    pthread_mutex_lock(&lock);
+}
+
+void swtimer_unlock(void) {
+    pthread_mutex_unlock(&lock);
+}
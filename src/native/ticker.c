@@ -0,0 +1,58 @@
+#include "ticker.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define NS_PER_SEC 1000000000L
+
+// The timer interrupt is a thread that wakes at each tick.
+static pthread_t thread;
+static volatile bool running = false;
+static void (*tick_fn)(void) = NULL;
+static unsigned long freq = 0;
+
+static void *_run(void *arg) {
+    (void)arg;
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    unsigned long remainder_cum = 0;
+
+    while (running) {
+        // Same period (and carried remainder) as the board's timer, in ns
+        remainder_cum += NS_PER_SEC % freq;
+        next.tv_nsec += (NS_PER_SEC / freq) + (remainder_cum >= freq);
+        if (remainder_cum >= freq) {
+            remainder_cum -= freq;
+        }
+        if (next.tv_nsec >= NS_PER_SEC) {
+            next.tv_nsec -= NS_PER_SEC;
+            next.tv_sec++;
+        }
+
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        if (running) {
+            tick_fn();
+        }
+    }
+
+    return NULL;
+}
+
+void ticker_start(unsigned long tick_freq, void (*tick)(void)) {
+    ticker_stop();
+
+    tick_fn = tick;
+    freq = tick_freq;
+    running = true;
+    pthread_create(&thread, NULL, _run, NULL);
+}
+
+void ticker_stop(void) {
+    if (running) {
+        running = false;
+        pthread_join(thread, NULL);
+    }
+}
@@ -0,0 +1,32 @@
+#include "uart.h"
+
+#include <stdio.h>
+
+// Whatever would go out over UART goes to stderr instead.
+
+void uart_init(int baud_rate) {
+    (void)baud_rate;
+}
+
+void uart_write(uint8_t data) {
+    fputc(data, stderr);
+}
+
+void uart_write_str(const char *str) {
+    fputs(str, stderr);
+}
+
+uint8_t uart_read(void) {
+    return 0;
+}
+
+void uart_en_rx_int(void) {
+}
+
+bool uart_rx_empty(void) {
+    return true;
+}
+
+bool uart_tx_empty(void) {
+    return true;
+}
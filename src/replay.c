@@ -0,0 +1,190 @@
+#include "replay.h"
+
+#include <string.h>
+
+#define MAGIC_0 'R'
+#define MAGIC_1 'P'
+
+static uint32_t _get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void _put32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// Instructions the emulator has gone through, executed or skipped while idle.
+static uint32_t _count(const CHIP8 *chip8) {
+    return chip8->num_instrs + chip8->num_idle_instrs;
+}
+
+static void _apply(CHIP8 *chip8, uint16_t pressed, uint16_t released) {
+    if (pressed)
+        chip8_press_keys(chip8, pressed);
+    if (released)
+        chip8_release_keys(chip8, released);
+}
+
+static bool _write_block(REPLAY *replay, uint32_t block) {
+    replay->dirty = false;
+    return replay->store.write(replay->store.ctx, block, replay->block);
+}
+
+static bool _valid_header(const uint8_t *block) {
+    return block[0] == MAGIC_0 && block[1] == MAGIC_1 && block[2] == REPLAY_VERSION;
+}
+
+bool replay_exists(const REPLAY_STORE *store) {
+    uint8_t block[SD_BLOCK_SIZE];
+
+    return store->num_blocks && store->read(store->ctx, 0, block) && _valid_header(block);
+}
+
+bool replay_record(REPLAY *replay, const REPLAY_STORE *store, CHIP8 *chip8) {
+    replay->mode = REPLAY_OFF;
+    replay->store = *store;
+
+    if (!store->num_blocks) {
+        return false;
+    }
+
+    memset(replay->block, 0, sizeof(replay->block));
+    replay->block[0] = MAGIC_0;
+    replay->block[1] = MAGIC_1;
+    replay->block[2] = REPLAY_VERSION;
+    _put32(&replay->block[4], chip8->rand_state);
+
+    if (!_write_block(replay, 0)) {
+        return false;
+    }
+
+    replay->mode = REPLAY_RECORD;
+    replay->slot = 1;
+    replay->count = UINT32_MAX;
+    replay->pressed = 0;
+    replay->released = 0;
+    replay->cycles = 0;
+
+    return true;
+}
+
+static void _record(REPLAY *replay) {
+    uint8_t *event = &replay->block[(replay->slot % REPLAY_EVENTS_PER_BLOCK) * REPLAY_EVENT_SIZE];
+
+    _put32(event, replay->count);
+    event[4] = replay->pressed;
+    event[5] = replay->pressed >> 8;
+    event[6] = replay->released;
+    event[7] = replay->released >> 8;
+
+    replay->slot++;
+    replay->dirty = true;
+
+    // Write out a full block and end the recording in the next one, if there is room.
+    if (replay->slot % REPLAY_EVENTS_PER_BLOCK == 0) {
+        uint32_t block = replay->slot / REPLAY_EVENTS_PER_BLOCK;
+
+        _write_block(replay, block - 1);
+        memset(replay->block, 0, sizeof(replay->block));
+
+        if (block >= replay->store.num_blocks) {
+            replay->mode = REPLAY_OFF;
+        } else {
+            _write_block(replay, block);
+        }
+    }
+}
+
+// Reads the next event, ending playback at the end of the recording.
+static void _read_next(REPLAY *replay) {
+    uint32_t block = replay->slot / REPLAY_EVENTS_PER_BLOCK;
+
+    if (block >= replay->store.num_blocks) {
+        replay->mode = REPLAY_OFF;
+        return;
+    }
+
+    if (replay->slot % REPLAY_EVENTS_PER_BLOCK == 0 &&
+        !replay->store.read(replay->store.ctx, block, replay->block)) {
+        replay->mode = REPLAY_OFF;
+        return;
+    }
+
+    const uint8_t *event = &replay->block[(replay->slot % REPLAY_EVENTS_PER_BLOCK) * REPLAY_EVENT_SIZE];
+    replay->next.instrs = _get32(event);
+    replay->next.pressed = event[4] | (event[5] << 8);
+    replay->next.released = event[6] | (event[7] << 8);
+    replay->slot++;
+
+    if (!replay->next.pressed && !replay->next.released) {
+        replay->mode = REPLAY_OFF;
+    }
+}
+
+bool replay_play(REPLAY *replay, const REPLAY_STORE *store, CHIP8 *chip8) {
+    replay->mode = REPLAY_OFF;
+    replay->store = *store;
+
+    if (!store->num_blocks || !store->read(store->ctx, 0, replay->block) || !_valid_header(replay->block)) {
+        return false;
+    }
+
+    chip8_seed(chip8, _get32(&replay->block[4]));
+
+    replay->mode = REPLAY_PLAY;
+    replay->slot = 1;
+    replay->count = UINT32_MAX;
+    _read_next(replay);
+
+    return true;
+}
+
+void replay_input(REPLAY *replay, CHIP8 *chip8, uint16_t pressed, uint16_t released) {
+    uint32_t count = _count(chip8);
+    bool moved = count != replay->count;
+    replay->count = count;
+
+    switch (replay->mode) {
+    case REPLAY_OFF:
+        _apply(chip8, pressed, released);
+        break;
+
+    case REPLAY_RECORD:
+        // A key released and pressed again before it was recorded is just held.
+        replay->pressed = pressed | replay->pressed;
+        replay->released = released | (replay->released & ~pressed);
+
+        if (moved && (replay->pressed || replay->released)) {
+            _apply(chip8, replay->pressed, replay->released);
+            _record(replay);
+            replay->pressed = 0;
+            replay->released = 0;
+        }
+
+        if (++replay->cycles >= REPLAY_FLUSH_CYCLES) {
+            replay->cycles = 0;
+            if (replay->dirty) {
+                _write_block(replay, replay->slot / REPLAY_EVENTS_PER_BLOCK);
+            }
+        }
+        break;
+
+    case REPLAY_PLAY:
+        while (moved && replay->mode == REPLAY_PLAY && replay->next.instrs <= count) {
+            _apply(chip8, replay->next.pressed, replay->next.released);
+            _read_next(replay);
+        }
+        break;
+    }
+}
+
+void replay_stop(REPLAY *replay) {
+    if (replay->mode == REPLAY_RECORD && replay->dirty) {
+        _write_block(replay, replay->slot / REPLAY_EVENTS_PER_BLOCK);
+    }
+
+    replay->mode = REPLAY_OFF;
+}
@@ -0,0 +1,256 @@
+#include "savestate.h"
+
+#include <string.h>
+
+#include "sd.h"
+
+#define HEADER_SIZE 8
+#define MAX_LITERALS 128
+#define MIN_RUN 3
+#define MAX_RUN 130
+#define RUN_BIAS 125
+
+// V registers, PC/SP/I, DT/ST, timer progress and PRNG, hires and quirks.
+#define SCALARS_SIZE (NUM_REGISTERS + 6 + 2 + 12 + 2)
+
+// Packs bytes into blocks, sending each block to the card as it fills.
+typedef struct {
+    uint8_t block[SD_BLOCK_SIZE];
+    int len;
+    int blocks;
+    bool ok;
+
+    uint8_t literals[MAX_LITERALS];
+    int num_literals;
+    uint8_t last;
+    int run;
+} PACKER;
+
+// Unpacks bytes from the blocks read off the card.
+typedef struct {
+    uint8_t block[SD_BLOCK_SIZE];
+    int pos;
+    int blocks;
+    bool ok;
+
+    // Bytes left to copy, or to repeat with repeat set.
+    int count;
+    bool repeat;
+    uint8_t value;
+} UNPACKER;
+
+static void _put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void _put32(uint8_t *p, uint32_t v) {
+    _put16(p, v);
+    _put16(p + 2, v >> 16);
+}
+
+static uint16_t _get16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t _get32(const uint8_t *p) {
+    return _get16(p) | ((uint32_t)_get16(p + 2) << 16);
+}
+
+static void _out(PACKER *p, uint8_t byte) {
+    p->block[p->len++] = byte;
+
+    if (p->len == SD_BLOCK_SIZE) {
+        p->ok = p->ok && p->blocks < SAVESTATE_BLOCKS && sd_write_next(p->block);
+        p->blocks++;
+        p->len = 0;
+    }
+}
+
+static void _flush_literals(PACKER *p) {
+    if (p->num_literals) {
+        _out(p, p->num_literals - 1);
+        for (int i = 0; i < p->num_literals; i++) {
+            _out(p, p->literals[i]);
+        }
+        p->num_literals = 0;
+    }
+}
+
+// Sends the current run as a repeat if it is long enough, or as literals.
+static void _end_run(PACKER *p) {
+    if (p->run >= MIN_RUN) {
+        _flush_literals(p);
+        _out(p, p->run + RUN_BIAS);
+        _out(p, p->last);
+    } else {
+        for (int i = 0; i < p->run; i++) {
+            p->literals[p->num_literals++] = p->last;
+            if (p->num_literals == MAX_LITERALS) {
+                _flush_literals(p);
+            }
+        }
+    }
+
+    p->run = 0;
+}
+
+static void _pack(PACKER *p, const uint8_t *data, int len) {
+    for (int i = 0; i < len; i++) {
+        if (p->run && data[i] == p->last && p->run < MAX_RUN) {
+            p->run++;
+        } else {
+            _end_run(p);
+            p->last = data[i];
+            p->run = 1;
+        }
+    }
+}
+
+static uint8_t _in(UNPACKER *u) {
+    if (u->pos == SD_BLOCK_SIZE) {
+        u->ok = u->ok && u->blocks < SAVESTATE_BLOCKS && sd_read_next(u->block);
+        u->blocks++;
+        u->pos = 0;
+    }
+
+    return u->block[u->pos++];
+}
+
+// Unpacks len bytes into data, or skips them if data is NULL.
+static void _unpack(UNPACKER *u, uint8_t *data, int len) {
+    for (int i = 0; i < len; i++) {
+        if (!u->count) {
+            uint8_t control = _in(u);
+
+            u->repeat = control >= MAX_LITERALS;
+            u->count = u->repeat ? control - RUN_BIAS : control + 1;
+            if (u->repeat) {
+                u->value = _in(u);
+            }
+        }
+
+        uint8_t byte = u->repeat ? u->value : _in(u);
+        if (data) {
+            data[i] = byte;
+        }
+        u->count--;
+    }
+}
+
+static void _header(uint8_t *header) {
+    const uint8_t h[HEADER_SIZE] = {'C', '8', 'S', SAVESTATE_VERSION, CHIP8_PAGE_MAJOR, 0, 0, 0};
+    memcpy(header, h, HEADER_SIZE);
+}
+
+bool savestate_save(CHIP8 *chip8, uint32_t addr) {
+    uint8_t scalars[SCALARS_SIZE];
+    uint8_t *s = scalars;
+
+    memcpy(s, chip8->V, NUM_REGISTERS);
+    s += NUM_REGISTERS;
+    _put16(s, chip8->PC);
+    _put16(s + 2, chip8->SP);
+    _put16(s + 4, chip8->I);
+    s[6] = chip8->DT;
+    s[7] = chip8->ST;
+    _put32(s + 8, chip8->delay_cum);
+    _put32(s + 12, chip8->sound_cum);
+    _put32(s + 16, chip8->rand_state);
+    s[20] = chip8->hires;
+    s[21] = chip8->quirks;
+
+    if (!sd_write_begin(addr)) {
+        return false;
+    }
+
+    PACKER p = {.ok = true};
+    _header(p.block);
+    p.len = HEADER_SIZE;
+
+    _pack(&p, scalars, sizeof(scalars));
+    _pack(&p, chip8->RAM, sizeof(chip8->RAM));
+    _pack(&p, (const uint8_t *)chip8->display, sizeof(chip8->display));
+    _pack(&p, (const uint8_t *)chip8->lores, sizeof(chip8->lores));
+    _end_run(&p);
+    _flush_literals(&p);
+
+    // Pad out the last block
+    while (p.len) {
+        _out(&p, 0);
+    }
+
+    return sd_write_end() && p.ok;
+}
+
+/* Reads the save at addr through, into the emulator's memory and scalars if
+apply is set. Returns whether it read fine and ended where a save ends: at
+the end of a run, followed only by padding. */
+static bool _read_state(CHIP8 *chip8, uint32_t addr, uint8_t *scalars, bool apply) {
+    UNPACKER u = {.ok = true, .blocks = 1};
+    uint8_t header[HEADER_SIZE];
+
+    if (!sd_read_begin(addr)) {
+        return false;
+    }
+
+    u.ok = sd_read_next(u.block);
+    _header(header);
+    if (!u.ok || memcmp(u.block, header, HEADER_SIZE)) {
+        sd_read_end();
+        return false;
+    }
+    u.pos = HEADER_SIZE;
+
+    _unpack(&u, scalars, SCALARS_SIZE);
+    _unpack(&u, apply ? chip8->RAM : NULL, sizeof(chip8->RAM));
+    _unpack(&u, apply ? (uint8_t *)chip8->display : NULL, sizeof(chip8->display));
+    _unpack(&u, apply ? (uint8_t *)chip8->lores : NULL, sizeof(chip8->lores));
+
+    bool ends = !u.count;
+    for (; u.pos < SD_BLOCK_SIZE; u.pos++) {
+        ends = ends && !u.block[u.pos];
+    }
+
+    sd_read_end();
+    return u.ok && ends;
+}
+
+SAVESTATE_RESULT savestate_load(CHIP8 *chip8, uint32_t addr) {
+    uint8_t scalars[SCALARS_SIZE];
+
+    // Checked all the way through first, as there is no room to load a copy
+    if (!_read_state(chip8, addr, scalars, false)) {
+        return SAVESTATE_NONE;
+    }
+    if (!_read_state(chip8, addr, scalars, true)) {
+        return SAVESTATE_BROKEN;
+    }
+
+    const uint8_t *s = scalars;
+    memcpy(chip8->V, s, NUM_REGISTERS);
+    s += NUM_REGISTERS;
+    chip8->PC = _get16(s);
+    chip8->SP = _get16(s + 2);
+    chip8->I = _get16(s + 4);
+    chip8->DT = s[6];
+    chip8->ST = s[7];
+    chip8->delay_cum = _get32(s + 8);
+    chip8->sound_cum = _get32(s + 12);
+    chip8->rand_state = _get32(s + 16);
+    chip8->hires = s[20];
+    chip8_set_quirks(chip8, s[21]);
+
+    // Nothing running carries over: start timing afresh and redraw everything.
+    chip8->prev_cycle_start = chip8->cur_cycle_start = chip8->hooks.clock(chip8->hooks.ctx);
+    chip8->cpu_debt = 0;
+    chip8->keys_released = 0;
+    chip8->idle = CHIP8_IDLE_NONE;
+    chip8->stop = CHIP8_STOP_NONE;
+    chip8->exit = false;
+    chip8_invalidate(chip8, 0, MAX_RAM);
+    chip8_mark_display_dirty(chip8);
+    chip8->display_updated = true;
+
+    return SAVESTATE_LOADED;
+}
@@ -3,7 +3,9 @@
 #include <stdlib.h>
 
 #include "delay.h"
+#include "frameprof.h"
 #include "gpio.h"
+#include "spi.h"
 
 // CS: A4
 // SCK: A5
@@ -11,12 +13,8 @@
 // MOSI: A7 // Keep high during read transfer (after sending command)?
 // Det: A9
 
-#define SPI_CLK (1 << 12)
-#define SPI1_START 0x40013000
-#define SPI1_CR1 (*((volatile uint32_t *)(SPI1_START + 0x00)))
-#define SPI1_CR2 (*((volatile uint32_t *)(SPI1_START + 0x04)))
-#define SPI1_SR (*((volatile uint32_t *)(SPI1_START + 0x08)))
-#define SPI1_DR (*((volatile uint32_t *)(SPI1_START + 0x0C)))
+#define CS 4
+#define DET 9
 
 #define RESET_DUMMY_CYCLES 10
 #define START_BITS 0x40
@@ -27,6 +25,8 @@
 #define CARD_IDLE 1
 #define CMD_OK 0
 #define RW_OK 0xFE
+#define MULTI_WRITE_TOKEN 0xFC
+#define STOP_TRAN_TOKEN 0xFD
 #define DATA_ACCEPTED 2
 #define INIT_MAX_ATTEMPTS 10000
 #define READ_MAX_ATTEMPTS 10000
@@ -88,57 +88,39 @@ const struct command WRITE_MULTIPLE_BLOCK = {
     0xFF};
 
 static void _gpio_init(void) {
-    // Disable reset state
-    GPIOA_CRL &= ~((1 << 18) | (1 << 22) | (1 << 30));
-
-    // MODEy (4, 5, 7 2MHz out, 6 in)
-    GPIOA_CRL |= ((1 << 17) | (1 << 21) | (1 << 29));
-
-    // CNFy (5, 7 alt out, 6 floating in)
-    GPIOA_CRL |= ((1 << 23) | (1 << 31));
+    // 4 gpo (CS), 5, 7 alt out (SCK, MOSI), 6 floating in (MISO)
+    gpio_set_mode(GPIOA, CS, GPIO_OUT);
+    gpio_set_mode(GPIOA, 5, GPIO_ALT_OUT);
+    gpio_set_mode(GPIOA, 6, GPIO_IN);
+    gpio_set_mode(GPIOA, 7, GPIO_ALT_OUT);
 }
 
 static void _spi_init1(void) {
-    RCC_APB2ENR |= SPI_CLK;
-    for (volatile int i = 0; i < 10; i++)
-        ;
-
     // CLK / 256
     // SD must be initialized with a clk speed of between 100-400KHz
     // When CPU clock is set to 72MHz, APB2 clock is set to 72Mhz
     // 72MHz / 256 equals roughly 280KHz
-    SPI1_CR1 |= (7 << 3);
-
-    SPI1_CR1 |= (1 << 9);  // Enable software CS
-    SPI1_CR2 |= (1 << 2);  // Enable CS output
-    SPI1_CR1 |= (1 << 2);  // Set as master
-    SPI1_CR1 |= (1 << 6);  // Enable
+    spi_init(SPI1, SPI_DIV_256, SPI_SOFT_CS);
 }
 
 static void _spi_init2(void) {
-    // Wait for SPI to finish up then disable it
+    // Wait for SPI to finish up
     delay(10);
-    SPI1_CR1 &= ~(1 << 6);
 
     // Change CS pin to alt function output
-    GPIOA_CRL |= (1 << 19);
-
-    // Change the frequency to something much faster
-    SPI1_CR1 &= ~(7 << 3);  // Erase old freq settings
-    SPI1_CR1 |= (1 << 5);   // CLK / 32 (might be able to go faster)
+    gpio_set_mode(GPIOA, CS, GPIO_ALT_OUT);
 
-    SPI1_CR1 &= ~(1 << 9);  // Disable software CS (thus enabling hardware CS)
-    SPI1_CR1 |= (1 << 6);   // Re-enable SPI
+    // Change the frequency to something much faster (might be able to go faster)
+    // and hand CS over to the SPI
+    spi_init(SPI1, SPI_DIV_32, 0);
 }
 
 static void _sd_write(uint8_t data) {
-    SPI1_DR = data;
-    while (!(SPI1_SR & 0x02))
-        ;
+    spi_write(SPI1, data);
 }
 
 static uint8_t _sd_read(void) {
-    return SPI1_DR;
+    return spi_read(SPI1);
 }
 
 static void _dummy_write(int n) {
@@ -179,7 +161,7 @@ static const uint8_t *_read_R3(void) {
 }
 
 static void _power_on(void) {
-    GPIOA_ODR |= (1 << 4);  // Set CS high
+    gpio_write(GPIOA, CS, true);  // Set CS high
 
     // Send >74 dummy clocks with MOSI high
     _dummy_write(RESET_DUMMY_CYCLES);
@@ -291,8 +273,8 @@ static bool _read_block_data(uint8_t *buffer) {
     return true;
 }
 
-static bool _write_block_data(const uint8_t *buffer) {
-    _sd_write(RW_OK);  // Send the packet start token
+static bool _write_block_data(const uint8_t *buffer, uint8_t token) {
+    _sd_write(token);  // Send the packet start token
 
     // Send all data bytes
     for (int i = 0; i < SD_BLOCK_SIZE; i++)
@@ -312,7 +294,7 @@ bool sd_init(void) {
     _power_on();
 
     // Set CS low manually since we aren't in full-blown SPI yet
-    GPIOA_ODR &= ~(1 << 4);
+    gpio_write(GPIOA, CS, false);
 
     // Ensure all stages of sequence were successful
     if (!_reset())
@@ -328,7 +310,7 @@ bool sd_init(void) {
 }
 
 bool sd_inserted(void) {
-    return (GPIOA_IDR & (1 << 9));
+    return gpio_read(GPIOA, DET);
 }
 
 bool sd_read_block(uint32_t addr, uint8_t *buffer) {
@@ -344,21 +326,33 @@ bool sd_read_block(uint32_t addr, uint8_t *buffer) {
     return true;
 }
 
-bool sd_read_blocks(uint32_t addr, uint8_t *buffer, int num_blocks) {
+bool sd_read_begin(uint32_t addr) {
     uint8_t args[NUM_ARGS];
     _split_addr(addr, args);
 
     _send_cmd(&READ_MULTIPLE_BLOCK, args);
-    if (_read_R1() == CMD_OK) {
+    return _read_R1() == CMD_OK;
+}
+
+bool sd_read_next(uint8_t *buffer) {
+    return _read_block_data(buffer);
+}
+
+void sd_read_end(void) {
+    // Signal we wish to stop reading data
+    _send_cmd(&STOP_TRANSMISSION, NULL);
+    _dummy_write(1);  // Discard stuff byte
+    _read_R1();
+}
+
+bool sd_read_blocks(uint32_t addr, uint8_t *buffer, int num_blocks) {
+    if (sd_read_begin(addr)) {
         for (int i = 0; i < num_blocks; i++) {
-            if (!_read_block_data(buffer + (i * SD_BLOCK_SIZE)))
+            if (!sd_read_next(buffer + (i * SD_BLOCK_SIZE)))
                 return false;
         }
 
-        // Signal we wish to stop reading data
-        _send_cmd(&STOP_TRANSMISSION, NULL);
-        _dummy_write(1);  // Discard stuff byte
-        _read_R1();
+        sd_read_end();
     }
 
     return true;
@@ -368,9 +362,49 @@ bool sd_write_block(uint32_t addr, const uint8_t *buffer) {
     uint8_t args[NUM_ARGS];
     _split_addr(addr, args);
 
+    // Writes block whatever called them, so keep them separate in the profile
+    FRAME_PHASE prev = frameprof_phase(FRAME_SD);
+    bool ok = false;
+
     _send_cmd(&WRITE_BLOCK, args);
     if (_read_R1() == CMD_OK)
-        return _write_block_data(buffer);
+        ok = _write_block_data(buffer, RW_OK);
 
-    return false;
+    frameprof_phase(prev);
+    return ok;
+}
+
+bool sd_write_begin(uint32_t addr) {
+    uint8_t args[NUM_ARGS];
+    _split_addr(addr, args);
+
+    FRAME_PHASE prev = frameprof_phase(FRAME_SD);
+    _send_cmd(&WRITE_MULTIPLE_BLOCK, args);
+    bool ok = _read_R1() == CMD_OK;
+
+    frameprof_phase(prev);
+    return ok;
+}
+
+bool sd_write_next(const uint8_t *buffer) {
+    FRAME_PHASE prev = frameprof_phase(FRAME_SD);
+
+    // Wait out the programming of the last block, then hand over this one without waiting for it
+    _rest();
+    bool ok = _write_block_data(buffer, MULTI_WRITE_TOKEN);
+
+    frameprof_phase(prev);
+    return ok;
+}
+
+bool sd_write_end(void) {
+    FRAME_PHASE prev = frameprof_phase(FRAME_SD);
+
+    _rest();
+    _sd_write(STOP_TRAN_TOKEN);
+    _dummy_write(1);  // Stuff byte
+    _rest();          // Busy until the last block is programmed
+
+    frameprof_phase(prev);
+    return true;
 }
@@ -0,0 +1,57 @@
+#include "spi.h"
+
+#include "gpio.h"
+
+#define SPI1_CLK (1 << 12)
+#define SPI2_CLK (1 << 14)
+
+#define SPI1_START 0x40013000
+#define SPI2_START 0x40003800
+
+#define SPI_CR1(spi) (*((volatile uint32_t *)(spi_start[spi] + 0x00)))
+#define SPI_CR2(spi) (*((volatile uint32_t *)(spi_start[spi] + 0x04)))
+#define SPI_SR(spi) (*((volatile uint32_t *)(spi_start[spi] + 0x08)))
+#define SPI_DR(spi) (*((volatile uint32_t *)(spi_start[spi] + 0x0C)))
+
+#define SPE (1 << 6)
+
+static const uint32_t spi_start[] = {SPI1_START, SPI2_START};
+
+void spi_init(SPI spi, SPI_DIV div, int flags) {
+    if (spi == SPI1) {
+        RCC_APB2ENR |= SPI1_CLK;
+    } else {
+        RCC_APB1ENR |= SPI2_CLK;
+    }
+    for (volatile int i = 0; i < 10; i++)
+        ;
+
+    // Can only be reconfigured while disabled
+    SPI_CR1(spi) &= ~SPE;
+
+    uint32_t cr1 = (div << 3);
+    cr1 |= (1 << 2);  // Set as master
+
+    if (flags & SPI_TX_ONLY) {
+        cr1 |= (1 << 15);  // 1 line mode
+        cr1 |= (1 << 14);  // Transmit-only
+    }
+
+    if (flags & SPI_SOFT_CS) {
+        cr1 |= (1 << 9);  // Enable software CS
+    }
+
+    SPI_CR1(spi) = cr1;
+    SPI_CR2(spi) |= (1 << 2);  // Enable CS output
+    SPI_CR1(spi) |= SPE;
+}
+
+void spi_write(SPI spi, uint8_t data) {
+    SPI_DR(spi) = data;
+    while (!(SPI_SR(spi) & 0x02))
+        ;
+}
+
+uint8_t spi_read(SPI spi) {
+    return SPI_DR(spi);
+}
@@ -0,0 +1,102 @@
+#include "swtimer.h"
+
+#include <stddef.h>
+
+#define SLOT_MASK (SWTIMER_SLOTS - 1)
+
+static SWTIMER *wheel[SWTIMER_SLOTS] = {0};
+static volatile uint32_t ticks = 0;
+
+static void _insert(SWTIMER *timer) {
+    SWTIMER **slot = &wheel[timer->expires & SLOT_MASK];
+
+    timer->next = *slot;
+    *slot = timer;
+}
+
+// Takes the timer out of its slot, if it is in one.
+static void _remove(SWTIMER *timer) {
+    for (SWTIMER **t = &wheel[timer->expires & SLOT_MASK]; *t; t = &(*t)->next) {
+        if (*t == timer) {
+            *t = timer->next;
+            return;
+        }
+    }
+}
+
+// The first timer in the slot that expires now, taken out of the wheel.
+static SWTIMER *_pop_due(uint32_t now) {
+    for (SWTIMER **t = &wheel[now & SLOT_MASK]; *t; t = &(*t)->next) {
+        SWTIMER *timer = *t;
+
+        if (timer->expires == now) {
+            *t = timer->next;
+            return timer;
+        }
+    }
+
+    return NULL;
+}
+
+void swtimer_start(SWTIMER *timer, uint32_t ms, uint32_t period, SWTIMER_FN fn, void *arg) {
+    swtimer_lock();
+
+    if (timer->active) {
+        _remove(timer);
+    }
+
+    timer->fn = fn;
+    timer->arg = arg;
+    timer->period = period;
+    timer->expires = ticks + (ms ? ms : 1);
+    timer->active = true;
+    _insert(timer);
+
+    swtimer_unlock();
+}
+
+void swtimer_stop(SWTIMER *timer) {
+    swtimer_lock();
+
+    if (timer->active) {
+        _remove(timer);
+        timer->active = false;
+    }
+
+    swtimer_unlock();
+}
+
+bool swtimer_active(const SWTIMER *timer) {
+    return timer->active;
+}
+
+uint32_t swtimer_ticks(void) {
+    return ticks;
+}
+
+void swtimer_tick(void) {
+    swtimer_lock();
+
+    uint32_t now = ++ticks;
+    SWTIMER *timer;
+
+    /* Timers a whole turn of the wheel or more away stay in the slot. The slot
+     * is searched again after each callback, as callbacks may change it. */
+    while ((timer = _pop_due(now))) {
+        SWTIMER_FN fn = timer->fn;
+        void *arg = timer->arg;
+
+        // Rearmed before the call, so the callback can stop it
+        if (timer->period) {
+            timer->expires = now + timer->period;
+            _insert(timer);
+        } else {
+            timer->active = false;
+        }
+
+        // A one-shot timer may be gone once its callback has run
+        fn(arg);
+    }
+
+    swtimer_unlock();
+}
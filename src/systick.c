@@ -0,0 +1,43 @@
+#include <stdint.h>
+
+#include "sysclk.h"
+#include "swtimer.h"
+#include "systick.h"
+
+#define ENABLE (1 << 0)
+#define TICKINT (1 << 1)
+#define CLKSOURCE (1 << 2)
+
+// The software timers' tick.
+
+static uint32_t lock_depth = 0;
+static uint32_t saved_primask = 0;
+
+void SysTick_Handler(void) {
+    swtimer_tick();
+}
+
+void swtimer_init(void) {
+    STCTRL = 0;
+    STRELOAD = (AHB_CLOCK_SPEED / SWTIMER_TICKS_PER_SEC) - 1;
+    STCURRENT = 0;
+    STCTRL = ENABLE | TICKINT | CLKSOURCE;
+}
+
+/* Interrupts are masked rather than just the tick's, which would lose a tick
+ * that came due meanwhile. The mask from before the outermost lock is put back
+ * by the last unlock. */
+void swtimer_lock(void) {
+    uint32_t primask;
+
+    __asm volatile("mrs %0, primask\n\tcpsid i" : "=r"(primask)::"memory");
+    if (!lock_depth++) {
+        saved_primask = primask;
+    }
+}
+
+void swtimer_unlock(void) {
+    if (!--lock_depth) {
+        __asm volatile("msr primask, %0" ::"r"(saved_primask) : "memory");
+    }
+}
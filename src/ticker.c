@@ -0,0 +1,79 @@
+#include "ticker.h"
+
+#include <stdint.h>
+
+#include "gpio.h"
+#include "sysclk.h"
+
+#define NVIC 0xE000E100
+#define NVIC_ISER0 (*((volatile uint32_t *)(NVIC + 0x00)))
+#define NVIC_ICER0 (*((volatile uint32_t *)(NVIC + 0x80)))
+#define TIM4_NVIC (1 << 30)
+
+#define TIM4 0x40000800
+#define TIM4_CR1 (*((volatile uint32_t *)(TIM4 + 0x00)))
+#define TIM4_DIER (*((volatile uint32_t *)(TIM4 + 0x0C)))
+#define TIM4_SR (*((volatile uint32_t *)(TIM4 + 0x10)))
+#define TIM4_EGR (*((volatile uint32_t *)(TIM4 + 0x14)))
+#define TIM4_PSC (*((volatile uint32_t *)(TIM4 + 0x28)))
+#define TIM4_ARR (*((volatile uint32_t *)(TIM4 + 0x2C)))
+#define TIM4EN (1 << 2)
+#define UIF 1
+#define UG 1
+
+#define TICKS_PER_SEC 1000000
+
+static void (*tick_fn)(void) = 0;
+
+// The period is TICKS_PER_SEC / freq us, plus 1 us whenever the remainder adds up.
+static uint32_t freq = 0;
+static uint32_t period = 0;
+static uint32_t remainder = 0;
+static uint32_t remainder_cum = 0;
+
+void TIM4_IRQHandler(void) {
+    TIM4_SR = ~UIF;  // Clear interrupt
+
+    // Length of the next period (the ARR isn't buffered, so it applies now)
+    remainder_cum += remainder;
+    if (remainder_cum >= freq) {
+        remainder_cum -= freq;
+        TIM4_ARR = period;
+    } else {
+        TIM4_ARR = period - 1;
+    }
+
+    tick_fn();
+}
+
+void ticker_start(unsigned long tick_freq, void (*tick)(void)) {
+    ticker_stop();
+
+    tick_fn = tick;
+    freq = tick_freq;
+    period = TICKS_PER_SEC / tick_freq;
+    remainder = TICKS_PER_SEC % tick_freq;
+    remainder_cum = 0;
+
+    RCC_APB1ENR |= TIM4EN;
+
+    // Count every us (APB1 timers run at twice its speed when it is divided down)
+    long timer_clock = APB1_CLOCK_SPEED == AHB_CLOCK_SPEED ? APB1_CLOCK_SPEED : APB1_CLOCK_SPEED * 2;
+    TIM4_PSC = (timer_clock / TICKS_PER_SEC) - 1;
+    TIM4_ARR = period - 1;
+
+    // Load the prescaler now and start the first period from 0
+    TIM4_EGR = UG;
+    TIM4_SR = ~UIF;
+
+    TIM4_DIER |= 1;
+    NVIC_ISER0 |= TIM4_NVIC;
+    TIM4_CR1 |= 1;
+}
+
+void ticker_stop(void) {
+    TIM4_CR1 &= ~1;
+    TIM4_DIER &= ~1;
+    NVIC_ICER0 = TIM4_NVIC;
+    TIM4_SR = ~UIF;
+}
@@ -1,6 +1,7 @@
 #include "uart.h"
 
 #include "gpio.h"
+#include "idle.h"
 #include "sysclk.h"
 
 #define NVIC 0xE000E100
@@ -14,6 +15,20 @@
 #define UART1_DR (*((volatile uint32_t *)(UART1 + 0x04)))
 #define UART1_BRR (*((volatile uint32_t *)(UART1 + 0x08)))
 
+#define RXNE 0x20
+
+// Byte taken off the receiver by the rx interrupt, until it is read.
+static volatile uint8_t rx_byte = 0;
+static volatile bool rx_full = false;
+
+void USART1_IRQHandler(void) {
+    if (UART1_SR & RXNE) {
+        rx_byte = UART1_DR;
+        rx_full = true;
+        idle_wake();
+    }
+}
+
 // Enable PORTA for UART1
 static void _gpio_init(void) {
     GPIOA_CRH |= 0xA0;   // Configure Tx
@@ -51,6 +66,11 @@ void uart_write_str(const char *str) {
 }
 
 uint8_t uart_read(void) {
+    if (rx_full) {
+        rx_full = false;
+        return rx_byte;
+    }
+
     return UART1_DR;
 }
 
@@ -60,7 +80,7 @@ void uart_en_rx_int(void) {
 }
 
 bool uart_rx_empty(void) {
-    return !(UART1_SR & 0x20);
+    return !rx_full && !(UART1_SR & RXNE);
 }
 
 bool uart_tx_empty(void) {
@@ -27,6 +27,7 @@ class ROM:
         a_btn_map=0x0040,
         b_btn_map=0x0040,
         user_flags=0x0040,
+        frame_sliced=False,
     ) -> None:
         self.sector_num = sector_num
         self.title = title
@@ -41,6 +42,7 @@ class ROM:
         self.a_btn_map = a_btn_map
         self.b_btn_map = b_btn_map
         self.user_flags = user_flags
+        self.frame_sliced = frame_sliced
 
 
 def restart_gui():
@@ -61,8 +63,10 @@ def load_rom(sd, n):
         title = data[1:12].decode()
         config = struct.unpack(">IBBBHHHHHH", data[12:31])
         user_flags = list(data[31:47])
+        # Bytes 47 on are only set if cartridge8 marked them
+        frame_sliced = data[48] == 1 and data[49:51] == bytes([ord("X"), 1])
 
-        return ROM(n, title, *config, user_flags)
+        return ROM(n, title, *config, user_flags, frame_sliced)
 
     # Otherwise return an empty ROM
     return ROM(n)
@@ -112,6 +116,11 @@ def save_rom(sender, data, input):
     sd = open(SD_PATH, "rb+")
     sd.seek(rom_num * (SD_BLOCK_SIZE * 8))
     sd.write(metadata)
+
+    # Scheduler, after the input recording block, then the marker that says
+    # bytes 47 on have been written (older versions left them as they were)
+    sd.seek((rom_num * (SD_BLOCK_SIZE * 8)) + 48)
+    sd.write(bytes([int(dpg.get_value(fields["frame_sliced"])), ord("X"), 1]))
     sd.close()
     print("Metadata Saved!")
 
@@ -130,6 +139,10 @@ def save_rom(sender, data, input):
     sd = open(SD_PATH, "rb+")
     sd.seek((rom_num * (SD_BLOCK_SIZE * 8)) + SD_BLOCK_SIZE)
     sd.write(rom_data)
+
+    # The new ROM may cover the input recording, so drop it
+    sd.seek((rom_num * (SD_BLOCK_SIZE * 8)) + 47)
+    sd.write(bytes([0]))
     sd.close()
 
     print("ROM Data Saved!")
@@ -215,6 +228,11 @@ def show_fields(rom):
             min_clamped=True,
         )
 
+    frame_sliced = dpg.add_checkbox(
+        label="Run CPU Freq / Timer Freq instructions per frame",
+        default_value=rom.frame_sliced,
+    )
+
     dpg.add_spacer(height=12)
     return {
         "file_path": file_path,
@@ -222,6 +240,7 @@ def show_fields(rom):
         "cpu_freq": cpu_freq,
         "timer_freq": timer_freq,
         "display_freq": display_freq,
+        "frame_sliced": frame_sliced,
     }
 
 
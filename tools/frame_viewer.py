@@ -0,0 +1,139 @@
+#!/usr/bin/python3
+
+# Shows the per-frame time breakdown sent by a FRAME_PROFILE=1 build.
+# Usage: frame_viewer.py [/dev/ttyUSB0 | file]
+# A file (e.g. the stderr of the native build) is played back instead.
+
+import os
+import sys
+import pygame
+import serial
+
+SYNC = 0xA5
+FRAME_RECORD = 0x01
+WINDOW_RECORD = 0x02
+
+PHASES = ["INPUT", "CPU", "SOUND", "DISPLAY", "SD", "IDLE", "PROFILER"]
+COLORS = [(80, 160, 255), (255, 120, 80), (255, 220, 80),
+          (120, 220, 120), (200, 100, 220), (48, 48, 48), (128, 128, 128)]
+
+BAR_WIDTH = 4
+GRAPH_HEIGHT = 300
+US_PER_PIXEL = 100  # 30 ms at the top of the graph
+
+
+def read_record():
+    # Skip anything until a sync byte, then check the whole record
+    while True:
+        b = source.read(1)
+        if not b:
+            return None
+        if b[0] != SYNC:
+            continue
+
+        header = source.read(2)
+        if len(header) < 2:
+            return None
+
+        rec_type, length = header
+        payload = source.read(length + 1)
+        if len(payload) < length + 1:
+            return None
+
+        if sum(payload[:length]) & 0xFF != payload[length]:
+            continue
+
+        values = [payload[i] | (payload[i + 1] << 8)
+                  for i in range(0, length, 2)]
+        return rec_type, values
+
+
+def draw_graph():
+    screen.fill(black)
+
+    x = width - BAR_WIDTH
+    for frame in reversed(frames):
+        y = GRAPH_HEIGHT
+        for phase, us in enumerate(frame[2:]):
+            h = us // US_PER_PIXEL
+            pygame.draw.rect(screen, COLORS[phase], (x, y - h, BAR_WIDTH - 1, h))
+            y -= h
+
+        x -= BAR_WIDTH
+        if x < 0:
+            break
+
+    # 60 Hz frame budget
+    budget = GRAPH_HEIGHT - (16667 // US_PER_PIXEL)
+    pygame.draw.line(screen, white, (0, budget), (width, budget))
+
+
+def draw_stats():
+    y = GRAPH_HEIGHT + 10
+
+    if frames:
+        text = "frame %d  loops %d" % (frames[-1][0], frames[-1][1])
+        screen.blit(font.render(text, True, white), (10, y))
+    y += 24
+
+    header = "%-9s %7s %7s %7s" % ("phase", "min", "avg", "max")
+    screen.blit(font.render(header, True, white), (10, y))
+    y += 20
+
+    for phase, name in enumerate(PHASES):
+        if window:
+            stats = window[1 + (phase * 3):4 + (phase * 3)]
+            text = "%-9s %7d %7d %7d" % (name, *stats)
+        else:
+            text = name
+        screen.blit(font.render(text, True, COLORS[phase]), (10, y))
+        y += 20
+
+
+def handle_input():
+    for event in pygame.event.get():
+        if event.type == pygame.QUIT:
+            sys.exit()
+
+
+port = sys.argv[1] if len(sys.argv) > 1 else "/dev/ttyUSB0"
+if os.path.isfile(port):
+    source = open(port, "rb")
+else:
+    source = serial.Serial(port=port, baudrate=500000, timeout=0.1)
+
+pygame.init()
+
+size = width, height = 640, GRAPH_HEIGHT + 180
+black = 0, 0, 0
+white = 255, 255, 255
+
+screen = pygame.display.set_mode(size)
+pygame.display.set_caption("CHIPnGo frame profile")
+font = pygame.font.SysFont("monospace", 16)
+
+frames = []
+window = None
+
+while True:
+    handle_input()
+
+    record = read_record()
+    if record is None:
+        if isinstance(source, serial.Serial):
+            continue
+
+        # End of a played back file, so just keep showing it
+        pygame.time.wait(100)
+        continue
+
+    rec_type, values = record
+    if rec_type == FRAME_RECORD:
+        frames.append(values)
+        frames = frames[-(width // BAR_WIDTH):]
+    elif rec_type == WINDOW_RECORD:
+        window = values
+
+    draw_graph()
+    draw_stats()
+    pygame.display.flip()